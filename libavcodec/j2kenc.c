@@ -76,6 +76,7 @@
 #include "libavutil/opt.h"
 #include "libavutil/intreadwrite.h"
 #include "libavutil/avstring.h"
+#include "libavutil/parseutils.h"
 #include "libavutil/thread.h"
 
 #define NMSEDEC_BITS 7
@@ -86,6 +87,9 @@
 #define CODEC_JP2 1
 #define CODEC_J2K 0
 
+#define TLM_MAX_ENTRIES ((65535 - 4) / 6) ///< Ttlm/Ptlm pairs fitting in one TLM segment
+#define PLT_MAX_LEN     (65535 - 3)       ///< Iplt bytes fitting in one PLT segment
+
 static int lut_nmsedec_ref [1<<NMSEDEC_BITS],
            lut_nmsedec_ref0[1<<NMSEDEC_BITS],
            lut_nmsedec_sig [1<<NMSEDEC_BITS],
@@ -142,6 +146,14 @@ typedef struct {
     int prog;
     int nlayers;
     char *lr_str;
+    int tlm;
+    int plt;
+    char *prec_str;
+    int bypass;
+
+    uint8_t *tlm_start;    ///< start of the TLM segments in the main header
+    int *packet_lengths;   ///< packet lengths of the current tile-part, for PLT
+    int nb_packets;
 } Jpeg2000EncoderContext;
 
 
@@ -217,24 +229,41 @@ static void dump(Jpeg2000EncoderContext *s, FILE *fd)
 
 /* bitstream routines */
 
-/** put n times val bit */
-static void put_bits(Jpeg2000EncoderContext *s, int val, int n) // TODO: optimize
+/**
+ * put n times val bit
+ * Whole runs are merged into the current byte; a byte following 0xff only
+ * takes 7 bits (bit stuffing).
+ */
+static void put_bits(Jpeg2000EncoderContext *s, int val, int n)
 {
-    while (n-- > 0){
-        if (s->bit_index == 8)
-        {
+    while (n > 0) {
+        int k;
+        if (s->bit_index == 8) {
             s->bit_index = *s->buf == 0xff;
             *(++s->buf) = 0;
         }
-        *s->buf |= val << (7 - s->bit_index++);
+        k = FFMIN(n, 8 - s->bit_index);
+        if (val)
+            *s->buf |= ((1 << k) - 1) << (8 - s->bit_index - k);
+        s->bit_index += k;
+        n -= k;
     }
 }
 
 /** put n least significant bits of a number num */
 static void put_num(Jpeg2000EncoderContext *s, int num, int n)
 {
-    while(--n >= 0)
-        put_bits(s, (num >> n) & 1, 1);
+    while (n > 0) {
+        int k;
+        if (s->bit_index == 8) {
+            s->bit_index = *s->buf == 0xff;
+            *(++s->buf) = 0;
+        }
+        k = FFMIN(n, 8 - s->bit_index);
+        n -= k;
+        *s->buf |= ((num >> n) & ((1 << k) - 1)) << (8 - s->bit_index - k);
+        s->bit_index += k;
+    }
 }
 
 /** flush the bitstream */
@@ -248,16 +277,25 @@ static void j2k_flush(Jpeg2000EncoderContext *s)
 
 /* tag tree routines */
 
-/** code the value stored in node */
+/**
+ * code the value stored in node
+ * Ancestors that are already fully coded (vis) emit no more bits, so the
+ * walk towards the root stops at the first of them.
+ */
 static void tag_tree_code(Jpeg2000EncoderContext *s, Jpeg2000TgtNode *node, int threshold)
 {
     Jpeg2000TgtNode *stack[30];
     int sp = -1, curval = 0;
 
-    while(node->parent){
+    if (node->vis)
+        return;
+
+    while (node->parent && !node->parent->vis) {
         stack[++sp] = node;
         node = node->parent;
     }
+    if (node->parent)
+        curval = node->parent->val;
 
     while (1) {
         if (curval > node->temp_val)
@@ -332,11 +370,15 @@ static int put_cod(Jpeg2000EncoderContext *s)
     Jpeg2000CodingStyle *codsty = &s->codsty;
     uint8_t scod = 0;
 
-    if (s->buf_end - s->buf < 14)
+    int i, lcod = 12 + (codsty->csty & JPEG2000_CSTY_PREC ? codsty->nreslevels : 0);
+
+    if (s->buf_end - s->buf < lcod + 2)
         return -1;
 
     bytestream_put_be16(&s->buf, JPEG2000_COD);
-    bytestream_put_be16(&s->buf, 12); // Lcod
+    bytestream_put_be16(&s->buf, lcod); // Lcod
+    if (codsty->csty & JPEG2000_CSTY_PREC)
+        scod |= JPEG2000_CSTY_PREC;
     if (s->sop)
         scod |= JPEG2000_CSTY_SOP;
     if (s->eph)
@@ -354,8 +396,11 @@ static int put_cod(Jpeg2000EncoderContext *s)
     bytestream_put_byte(&s->buf, codsty->nreslevels - 1); // num of decomp. levels
     bytestream_put_byte(&s->buf, codsty->log2_cblk_width-2); // cblk width
     bytestream_put_byte(&s->buf, codsty->log2_cblk_height-2); // cblk height
-    bytestream_put_byte(&s->buf, 0); // cblk style
+    bytestream_put_byte(&s->buf, codsty->cblk_style); // cblk style
     bytestream_put_byte(&s->buf, codsty->transform == FF_DWT53); // transformation
+    if (codsty->csty & JPEG2000_CSTY_PREC)
+        for (i = 0; i < codsty->nreslevels; i++) // PPx, PPy
+            bytestream_put_byte(&s->buf, codsty->log2_prec_heights[i] << 4 | codsty->log2_prec_widths[i]);
     return 0;
 }
 
@@ -423,6 +468,98 @@ static uint8_t *put_sot(Jpeg2000EncoderContext *s, int tileno)
     return psotptr;
 }
 
+/**
+ * reserve the TLM segments of the main header
+ * The tile-part lengths are filled in by update_tlm() once known.
+ */
+static int put_tlm(Jpeg2000EncoderContext *s)
+{
+    int ntiles = s->numXtiles * s->numYtiles;
+    int nsegs = ff_jpeg2000_ceildiv(ntiles, TLM_MAX_ENTRIES);
+    int i;
+
+    if (nsegs > 256) {
+        av_log(s->avctx, AV_LOG_ERROR, "Too many tiles for TLM markers\n");
+        return AVERROR(EINVAL);
+    }
+    if (s->buf_end - s->buf < 6 * (nsegs + ntiles))
+        return -1;
+
+    s->tlm_start = s->buf;
+    for (i = 0; i < nsegs; i++) {
+        int n = FFMIN(ntiles - i * TLM_MAX_ENTRIES, TLM_MAX_ENTRIES);
+        bytestream_put_be16(&s->buf, JPEG2000_TLM);
+        bytestream_put_be16(&s->buf, 4 + 6 * n); // Ltlm
+        bytestream_put_byte(&s->buf, i);         // Ztlm
+        bytestream_put_byte(&s->buf, 0x60);      // Stlm: 16 bit Ttlm, 32 bit Ptlm
+        memset(s->buf, 0, 6 * n);                // Ttlm, Ptlm (filled in later)
+        s->buf += 6 * n;
+    }
+    return 0;
+}
+
+static void update_tlm(Jpeg2000EncoderContext *s, int tileno, uint32_t len)
+{
+    int seg = tileno / TLM_MAX_ENTRIES;
+    uint8_t *ptr = s->tlm_start + seg * (6 + 6 * TLM_MAX_ENTRIES) +
+                   6 + 6 * (tileno % TLM_MAX_ENTRIES);
+
+    bytestream_put_be16(&ptr, tileno); // Ttlm
+    bytestream_put_be32(&ptr, len);    // Ptlm
+}
+
+/**
+ * insert the PLT segments of the current tile-part at pos
+ * Everything from pos up to the current position is moved behind them.
+ */
+static int put_plt(Jpeg2000EncoderContext *s, uint8_t *pos)
+{
+    int i, size = 0, len = 0, nsegs = 0;
+    uint8_t *ptr, *lplt = NULL;
+
+    for (i = 0; i < s->nb_packets; i++) {
+        int n = av_log2(s->packet_lengths[i]) / 7 + 1;
+        if (!nsegs || len + n > PLT_MAX_LEN) {
+            nsegs++;
+            size += 5;
+            len = 0;
+        }
+        len  += n;
+        size += n;
+    }
+    if (!nsegs)
+        return 0;
+    if (nsegs > 256) {
+        av_log(s->avctx, AV_LOG_ERROR, "Too many packets for PLT markers\n");
+        return AVERROR(EINVAL);
+    }
+    if (s->buf_end - s->buf < size)
+        return -1;
+
+    memmove(pos + size, pos, s->buf - pos);
+    s->buf += size;
+
+    ptr = pos;
+    nsegs = 0;
+    for (i = 0; i < s->nb_packets; i++) {
+        unsigned v = s->packet_lengths[i];
+        int n = av_log2(v) / 7 + 1;
+        if (!lplt || ptr - lplt - 3 + n > PLT_MAX_LEN) {
+            if (lplt)
+                AV_WB16(lplt, ptr - lplt);
+            bytestream_put_be16(&ptr, JPEG2000_PLT);
+            lplt = ptr;
+            bytestream_put_be16(&ptr, 0);      // Lplt (filled in later)
+            bytestream_put_byte(&ptr, nsegs++); // Zplt
+        }
+        while (--n)
+            bytestream_put_byte(&ptr, 0x80 | ((v >> 7 * n) & 0x7f));
+        bytestream_put_byte(&ptr, v & 0x7f); // Iplt
+    }
+    AV_WB16(lplt, ptr - lplt);
+    return 0;
+}
+
 static void compute_rates(Jpeg2000EncoderContext* s)
 {
     int i, j;
@@ -612,9 +749,11 @@ static int getnmsedec_ref(int x, int bpno)
     return lut_nmsedec_ref0[x & ((1 << NMSEDEC_BITS) - 1)];
 }
 
+/* tier-1 pass routines: bpno is the coded bit position, nmsedec is NULL
+ * when no distortion has to be tracked */
 static void encode_sigpass(Jpeg2000T1Context *t1, int width, int height, int bandno, int *nmsedec, int bpno)
 {
-    int y0, x, y, mask = 1 << (bpno + NMSEDEC_FRACBITS);
+    int y0, x, y, mask = 1 << bpno;
     for (y0 = 0; y0 < height; y0 += 4)
         for (x = 0; x < width; x++)
             for (y = y0; y < height && y < y0+4; y++){
@@ -625,8 +764,11 @@ static void encode_sigpass(Jpeg2000T1Context *t1, int width, int height, int ban
                     if (bit){
                         int xorbit;
                         int ctxno = ff_jpeg2000_getsgnctxno(t1->flags[(y+1) * t1->stride + x+1], &xorbit);
-                        ff_mqc_encode(&t1->mqc, t1->mqc.cx_states + ctxno, (t1->flags[(y+1) * t1->stride + x+1] >> 15) ^ xorbit);
-                        *nmsedec += getnmsedec_sig(t1->data[(y) * t1->stride + x], bpno + NMSEDEC_FRACBITS);
+                        int sign = t1->flags[(y+1) * t1->stride + x+1] >> 15;
+                        // the raw sign bit is coded as is
+                        ff_mqc_encode(&t1->mqc, t1->mqc.cx_states + ctxno, t1->mqc.raw ? sign : sign ^ xorbit);
+                        if (nmsedec)
+                            *nmsedec += getnmsedec_sig(t1->data[(y) * t1->stride + x], bpno);
                         ff_jpeg2000_set_significance(t1, x, y, t1->flags[(y+1) * t1->stride + x+1] >> 15);
                     }
                     t1->flags[(y+1) * t1->stride + x+1] |= JPEG2000_T1_VIS;
@@ -636,13 +778,14 @@ static void encode_sigpass(Jpeg2000T1Context *t1, int width, int height, int ban
 
 static void encode_refpass(Jpeg2000T1Context *t1, int width, int height, int *nmsedec, int bpno)
 {
-    int y0, x, y, mask = 1 << (bpno + NMSEDEC_FRACBITS);
+    int y0, x, y, mask = 1 << bpno;
     for (y0 = 0; y0 < height; y0 += 4)
         for (x = 0; x < width; x++)
             for (y = y0; y < height && y < y0+4; y++)
                 if ((t1->flags[(y+1) * t1->stride + x+1] & (JPEG2000_T1_SIG | JPEG2000_T1_VIS)) == JPEG2000_T1_SIG){
                     int ctxno = ff_jpeg2000_getrefctxno(t1->flags[(y+1) * t1->stride + x+1]);
-                    *nmsedec += getnmsedec_ref(t1->data[(y) * t1->stride + x], bpno + NMSEDEC_FRACBITS);
+                    if (nmsedec)
+                        *nmsedec += getnmsedec_ref(t1->data[(y) * t1->stride + x], bpno);
                     ff_mqc_encode(&t1->mqc, t1->mqc.cx_states + ctxno, t1->data[(y) * t1->stride + x] & mask ? 1:0);
                     t1->flags[(y+1) * t1->stride + x+1] |= JPEG2000_T1_REF;
                 }
@@ -650,7 +793,7 @@ static void encode_refpass(Jpeg2000T1Context *t1, int width, int height, int *nm
 
 static void encode_clnpass(Jpeg2000T1Context *t1, int width, int height, int bandno, int *nmsedec, int bpno)
 {
-    int y0, x, y, mask = 1 << (bpno + NMSEDEC_FRACBITS);
+    int y0, x, y, mask = 1 << bpno;
     for (y0 = 0; y0 < height; y0 += 4)
         for (x = 0; x < width; x++){
             if (y0 + 3 < height && !(
@@ -677,7 +820,8 @@ static void encode_clnpass(Jpeg2000T1Context *t1, int width, int height, int ban
                         if (t1->data[(y) * t1->stride + x] & mask){ // newly significant
                             int xorbit;
                             int ctxno = ff_jpeg2000_getsgnctxno(t1->flags[(y+1) * t1->stride + x+1], &xorbit);
-                            *nmsedec += getnmsedec_sig(t1->data[(y) * t1->stride + x], bpno + NMSEDEC_FRACBITS);
+                            if (nmsedec)
+                                *nmsedec += getnmsedec_sig(t1->data[(y) * t1->stride + x], bpno);
                             ff_mqc_encode(&t1->mqc, t1->mqc.cx_states + ctxno, (t1->flags[(y+1) * t1->stride + x+1] >> 15) ^ xorbit);
                             ff_jpeg2000_set_significance(t1, x, y, t1->flags[(y+1) * t1->stride + x+1] >> 15);
                         }
@@ -692,7 +836,8 @@ static void encode_clnpass(Jpeg2000T1Context *t1, int width, int height, int ban
                         if (t1->data[(y) * t1->stride + x] & mask){ // newly significant
                             int xorbit;
                             int ctxno = ff_jpeg2000_getsgnctxno(t1->flags[(y+1) * t1->stride + x+1], &xorbit);
-                            *nmsedec += getnmsedec_sig(t1->data[(y) * t1->stride + x], bpno + NMSEDEC_FRACBITS);
+                            if (nmsedec)
+                                *nmsedec += getnmsedec_sig(t1->data[(y) * t1->stride + x], bpno);
                             ff_mqc_encode(&t1->mqc, t1->mqc.cx_states + ctxno, (t1->flags[(y+1) * t1->stride + x+1] >> 15) ^ xorbit);
                             ff_jpeg2000_set_significance(t1, x, y, t1->flags[(y+1) * t1->stride + x+1] >> 15);
                         }
@@ -703,10 +848,17 @@ static void encode_clnpass(Jpeg2000T1Context *t1, int width, int height, int ban
         }
 }
 
+/**
+ * Code a block in all its passes. In lossless mode the coefficients carry no
+ * fractional bits and all passes are kept, so neither the distortion nor the
+ * rates of the intermediate truncation points are computed.
+ */
 static void encode_cblk(Jpeg2000EncoderContext *s, Jpeg2000T1Context *t1, Jpeg2000Cblk *cblk, Jpeg2000Tile *tile,
-                        int width, int height, int bandpos, int lev)
+                        int width, int height, int bandpos, int lev, int lossless)
 {
     int pass_t = 2, passno, x, y, max=0, nmsedec, bpno;
+    int seg_start = 0, term;
+    int fracbits = lossless ? 0 : NMSEDEC_FRACBITS;
     int64_t wmsedec = 0;
 
     memset(t1->flags, 0, t1->stride * (height + 2) * sizeof(*t1->flags));
@@ -725,27 +877,35 @@ static void encode_cblk(Jpeg2000EncoderContext *s, Jpeg2000T1Context *t1, Jpeg20
         cblk->nonzerobits = 0;
         bpno = 0;
     } else{
-        cblk->nonzerobits = av_log2(max) + 1 - NMSEDEC_FRACBITS;
+        cblk->nonzerobits = av_log2(max) + 1 - fracbits;
         bpno = cblk->nonzerobits - 1;
     }
 
     cblk->data[0] = 0;
-    ff_mqc_initenc(&t1->mqc, cblk->data + 1);
+    ff_mqc_initenc(&t1->mqc, cblk->data + 1, 0, 1);
 
     for (passno = 0; bpno >= 0; passno++){
         nmsedec=0;
 
         switch(pass_t){
-            case 0: encode_sigpass(t1, width, height, bandpos, &nmsedec, bpno);
+            case 0: encode_sigpass(t1, width, height, bandpos, lossless ? NULL : &nmsedec, bpno + fracbits);
                     break;
-            case 1: encode_refpass(t1, width, height, &nmsedec, bpno);
+            case 1: encode_refpass(t1, width, height, lossless ? NULL : &nmsedec, bpno + fracbits);
                     break;
-            case 2: encode_clnpass(t1, width, height, bandpos, &nmsedec, bpno);
+            case 2: encode_clnpass(t1, width, height, bandpos, lossless ? NULL : &nmsedec, bpno + fracbits);
                     break;
         }
 
-        cblk->passes[passno].rate = ff_mqc_flush_to(&t1->mqc, cblk->passes[passno].flushed, &cblk->passes[passno].flushed_len);
-        cblk->passes[passno].rate -= cblk->passes[passno].flushed_len;
+        if ((term = needs_termination(s->codsty.cblk_style, passno))) {
+            // terminated codeword segment, the next one starts right after it
+            seg_start += ff_mqc_flush(&t1->mqc);
+            cblk->passes[passno].rate = seg_start;
+            cblk->passes[passno].flushed_len = 0;
+            ff_mqc_initenc(&t1->mqc, cblk->data + 1 + seg_start, term == 2, 0);
+        } else if (!lossless) {
+            cblk->passes[passno].rate = seg_start + ff_mqc_flush_to(&t1->mqc, cblk->passes[passno].flushed, &cblk->passes[passno].flushed_len);
+            cblk->passes[passno].rate -= cblk->passes[passno].flushed_len;
+        }
 
         wmsedec += (int64_t)nmsedec << (2*bpno);
         cblk->passes[passno].disto = wmsedec;
@@ -758,8 +918,8 @@ static void encode_cblk(Jpeg2000EncoderContext *s, Jpeg2000T1Context *t1, Jpeg20
     cblk->npasses = passno;
     cblk->ninclpasses = passno;
 
-    if (passno) {
-        cblk->passes[passno-1].rate = ff_mqc_flush_to(&t1->mqc, cblk->passes[passno-1].flushed, &cblk->passes[passno-1].flushed_len);
+    if (passno && !needs_termination(s->codsty.cblk_style, passno-1)) {
+        cblk->passes[passno-1].rate = seg_start + ff_mqc_flush_to(&t1->mqc, cblk->passes[passno-1].flushed, &cblk->passes[passno-1].flushed_len);
         cblk->passes[passno-1].rate -= cblk->passes[passno-1].flushed_len;
     }
 }
@@ -781,12 +941,32 @@ static void putnumpasses(Jpeg2000EncoderContext *s, int n)
 }
 
 
+/**
+ * Find the end of the codeword segment starting at pass passno; a segment
+ * ends on a terminated pass or with the last pass of the layer.
+ */
+static int segment_end(int cblk_style, int passno, int end)
+{
+    while (passno < end - 1 && !needs_termination(cblk_style, passno))
+        passno++;
+    return passno + 1;
+}
+
+static int segment_length(Jpeg2000Cblk *cblk, int start, int end, int last)
+{
+    int length = cblk->passes[end - 1].rate - (start ? cblk->passes[start - 1].rate : 0);
+    if (last)
+        length += cblk->passes[end - 1].flushed_len;
+    return length;
+}
+
 static int encode_packet(Jpeg2000EncoderContext *s, Jpeg2000ResLevel *rlevel, int layno,
                          int precno, uint8_t *expn, int numgbits, int packetno,
                          int nlayers)
 {
     int bandno, empty = 1;
     int i;
+    uint8_t *packet_start = s->buf;
     // init bitstream
     *s->buf = 0;
     s->bit_index = 0;
@@ -853,6 +1033,8 @@ static int encode_packet(Jpeg2000EncoderContext *s, Jpeg2000ResLevel *rlevel, in
         j2k_flush(s);
         if (s->eph)
             bytestream_put_be16(&s->buf, JPEG2000_EPH);
+        if (s->packet_lengths)
+            s->packet_lengths[packetno] = s->buf - packet_start;
         return 0;
     }
 
@@ -868,7 +1050,7 @@ static int encode_packet(Jpeg2000EncoderContext *s, Jpeg2000ResLevel *rlevel, in
 
         for (pos=0, yi = 0; yi < prec->nb_codeblocks_height; yi++) {
             for (xi = 0; xi < cblknw; xi++, pos++){
-                int llen = 0, length;
+                int llen = 0, length, passno, pend, start, end;
                 Jpeg2000Cblk *cblk = prec->cblk + yi * cblknw + xi;
 
                 if (s->buf_end - s->buf < 20) // approximately
@@ -893,19 +1075,25 @@ static int encode_packet(Jpeg2000EncoderContext *s, Jpeg2000ResLevel *rlevel, in
                 // number of passes
                 putnumpasses(s, cblk->layers[layno].npasses);
 
-                length = cblk->layers[layno].data_len;
-                if (layno == nlayers - 1 && cblk->layers[layno].cum_passes){
-                    length += cblk->passes[cblk->layers[layno].cum_passes-1].flushed_len;
-                }
-                if (cblk->lblock + av_log2(cblk->layers[layno].npasses) < av_log2(length) + 1) {
-                    llen = av_log2(length) + 1 - cblk->lblock - av_log2(cblk->layers[layno].npasses);
+                // one length per codeword segment
+                end   = cblk->layers[layno].cum_passes;
+                start = end - cblk->layers[layno].npasses;
+                for (passno = start; passno < end; passno = pend) {
+                    pend   = segment_end(s->codsty.cblk_style, passno, end);
+                    length = segment_length(cblk, passno, pend, layno == nlayers - 1 && pend == end);
+                    if (cblk->lblock + llen + av_log2(pend - passno) < av_log2(length) + 1)
+                        llen = av_log2(length) + 1 - cblk->lblock - av_log2(pend - passno);
                 }
 
                 // length of code block
                 cblk->lblock += llen;
                 put_bits(s, 1, llen);
                 put_bits(s, 0, 1);
-                put_num(s, length, cblk->lblock + av_log2(cblk->layers[layno].npasses));
+                for (passno = start; passno < end; passno = pend) {
+                    pend   = segment_end(s->codsty.cblk_style, passno, end);
+                    length = segment_length(cblk, passno, pend, layno == nlayers - 1 && pend == end);
+                    put_num(s, length, cblk->lblock + av_log2(pend - passno));
+                }
             }
         }
     }
@@ -934,6 +1122,8 @@ static int encode_packet(Jpeg2000EncoderContext *s, Jpeg2000ResLevel *rlevel, in
             }
         }
     }
+    if (s->packet_lengths)
+        s->packet_lengths[packetno] = s->buf - packet_start;
     return 0;
 }
 
@@ -1179,6 +1369,7 @@ static int encode_packets(Jpeg2000EncoderContext *s, Jpeg2000Tile *tile, int til
 
     }
 
+    s->nb_packets = packetno;
     av_log(s->avctx, AV_LOG_DEBUG, "after tier2\n");
     return 0;
 }
@@ -1367,7 +1558,7 @@ static int getcut(Jpeg2000Cblk *cblk, int64_t lambda, int dwt_norm)
     return res;
 }
 
-static void truncpasses(Jpeg2000EncoderContext *s, Jpeg2000Tile *tile)
+static void truncpasses(Jpeg2000EncoderContext *s, Jpeg2000Tile *tile, int lossless)
 {
     int precno, compno, reslevelno, bandno, cblkno, lev;
     Jpeg2000CodingStyle *codsty = &s->codsty;
@@ -1387,8 +1578,11 @@ static void truncpasses(Jpeg2000EncoderContext *s, Jpeg2000Tile *tile)
                     for (cblkno = 0; cblkno < prec->nb_codeblocks_height * prec->nb_codeblocks_width; cblkno++){
                         Jpeg2000Cblk *cblk = prec->cblk + cblkno;
 
-                        cblk->ninclpasses = getcut(cblk, s->lambda,
-                                (int64_t)dwt_norms[codsty->transform == FF_DWT53][bandpos][lev] * (int64_t)band->i_stepsize >> 15);
+                        if (lossless)
+                            cblk->ninclpasses = cblk->npasses;
+                        else
+                            cblk->ninclpasses = getcut(cblk, s->lambda,
+                                    (int64_t)dwt_norms[codsty->transform == FF_DWT53][bandpos][lev] * (int64_t)band->i_stepsize >> 15);
                         cblk->layers[0].data_start = cblk->data;
                         cblk->layers[0].cum_passes = cblk->ninclpasses;
                         cblk->layers[0].npasses = cblk->ninclpasses;
@@ -1406,6 +1600,8 @@ static int encode_tile(Jpeg2000EncoderContext *s, Jpeg2000Tile *tile, int tileno
     int compno, reslevelno, bandno, ret;
     Jpeg2000T1Context t1;
     Jpeg2000CodingStyle *codsty = &s->codsty;
+    // reversible transform with every pass kept: code the integer coefficients directly
+    int lossless = codsty->transform == FF_DWT53 && !s->compression_rate_enc && !s->lambda;
     for (compno = 0; compno < s->ncomponents; compno++){
         Jpeg2000Component *comp = s->tile[tileno].comp + compno;
 
@@ -1421,30 +1617,30 @@ static int encode_tile(Jpeg2000EncoderContext *s, Jpeg2000Tile *tile, int tileno
 
             for (bandno = 0; bandno < reslevel->nbands ; bandno++){
                 Jpeg2000Band *band = reslevel->band + bandno;
-                Jpeg2000Prec *prec = band->prec; // we support only 1 precinct per band ATM in the encoder
-                int cblkx, cblky, cblkno=0, xx0, x0, xx1, y0, yy0, yy1, bandpos;
-                yy0 = bandno == 0 ? 0 : comp->reslevel[reslevelno-1].coord[1][1] - comp->reslevel[reslevelno-1].coord[1][0];
-                y0 = yy0;
-                yy1 = FFMIN(ff_jpeg2000_ceildivpow2(band->coord[1][0] + 1, band->log2_cblk_height) << band->log2_cblk_height,
-                            band->coord[1][1]) - band->coord[1][0] + yy0;
+                int precno, bandpos;
 
                 if (band->coord[0][0] == band->coord[0][1] || band->coord[1][0] == band->coord[1][1])
                     continue;
 
                 bandpos = bandno + (reslevelno > 0);
 
-                for (cblky = 0; cblky < prec->nb_codeblocks_height; cblky++){
-                    if (reslevelno == 0 || bandno == 1)
-                        xx0 = 0;
-                    else
-                        xx0 = comp->reslevel[reslevelno-1].coord[0][1] - comp->reslevel[reslevelno-1].coord[0][0];
-                    x0 = xx0;
-                    xx1 = FFMIN(ff_jpeg2000_ceildivpow2(band->coord[0][0] + 1, band->log2_cblk_width) << band->log2_cblk_width,
-                                band->coord[0][1]) - band->coord[0][0] + xx0;
+                for (precno = 0; precno < reslevel->num_precincts_x * reslevel->num_precincts_y; precno++){
+                    Jpeg2000Prec *prec = band->prec + precno;
+                    int cblkno;
 
-                    for (cblkx = 0; cblkx < prec->nb_codeblocks_width; cblkx++, cblkno++){
+                    for (cblkno = 0; cblkno < prec->nb_codeblocks_width * prec->nb_codeblocks_height; cblkno++){
+                        Jpeg2000Cblk *cblk = prec->cblk + cblkno;
+                        int xx0 = cblk->coord[0][0] - band->coord[0][0],
+                            xx1 = cblk->coord[0][1] - band->coord[0][0],
+                            yy0 = cblk->coord[1][0] - band->coord[1][0],
+                            yy1 = cblk->coord[1][1] - band->coord[1][0];
                         int y, x;
-                        if (codsty->transform == FF_DWT53){
+                        if (lossless){
+                            for (y = yy0; y < yy1; y++)
+                                memcpy(t1.data + (y-yy0)*t1.stride,
+                                       comp->i_data + (comp->coord[0][1] - comp->coord[0][0]) * y + xx0,
+                                       (xx1 - xx0) * sizeof(*t1.data));
+                        } else if (codsty->transform == FF_DWT53){
                             for (y = yy0; y < yy1; y++){
                                 int *ptr = t1.data + (y-yy0)*t1.stride;
                                 for (x = xx0; x < xx1; x++){
@@ -1461,19 +1657,15 @@ static int encode_tile(Jpeg2000EncoderContext *s, Jpeg2000Tile *tile, int tileno
                                 }
                             }
                         }
-                        if (!prec->cblk[cblkno].data)
-                            prec->cblk[cblkno].data = av_malloc(1 + 8192);
-                        if (!prec->cblk[cblkno].passes)
-                            prec->cblk[cblkno].passes = av_malloc_array(JPEG2000_MAX_PASSES, sizeof (*prec->cblk[cblkno].passes));
-                        if (!prec->cblk[cblkno].data || !prec->cblk[cblkno].passes)
+                        if (!cblk->data)
+                            cblk->data = av_malloc(1 + 8192);
+                        if (!cblk->passes)
+                            cblk->passes = av_malloc_array(JPEG2000_MAX_PASSES, sizeof (*cblk->passes));
+                        if (!cblk->data || !cblk->passes)
                             return AVERROR(ENOMEM);
-                        encode_cblk(s, &t1, prec->cblk + cblkno, tile, xx1 - xx0, yy1 - yy0,
-                                    bandpos, codsty->nreslevels - reslevelno - 1);
-                        xx0 = xx1;
-                        xx1 = FFMIN(xx1 + (1 << band->log2_cblk_width), band->coord[0][1] - band->coord[0][0] + x0);
+                        encode_cblk(s, &t1, cblk, tile, xx1 - xx0, yy1 - yy0,
+                                    bandpos, codsty->nreslevels - reslevelno - 1, lossless);
                     }
-                    yy0 = yy1;
-                    yy1 = FFMIN(yy1 + (1 << band->log2_cblk_height), band->coord[1][1] - band->coord[1][0] + y0);
                 }
             }
         }
@@ -1484,7 +1676,7 @@ static int encode_tile(Jpeg2000EncoderContext *s, Jpeg2000Tile *tile, int tileno
     if (s->compression_rate_enc)
         makelayers(s, tile);
     else
-        truncpasses(s, tile);
+        truncpasses(s, tile, lossless);
 
     if ((ret = encode_packets(s, tile, tileno, s->nlayers)) < 0)
         return ret;
@@ -1639,17 +1831,26 @@ static int encode_frame(AVCodecContext *avctx, AVPacket *pkt,
         return ret;
     if ((ret = put_com(s, 0)) < 0)
         return ret;
+    if (s->tlm && (ret = put_tlm(s)) < 0)
+        return ret;
 
     for (tileno = 0; tileno < s->numXtiles * s->numYtiles; tileno++){
-        uint8_t *psotptr;
+        uint8_t *psotptr, *sodptr;
+        uint32_t psot;
         if (!(psotptr = put_sot(s, tileno)))
             return -1;
         if (s->buf_end - s->buf < 2)
             return -1;
+        sodptr = s->buf;
         bytestream_put_be16(&s->buf, JPEG2000_SOD);
         if ((ret = encode_tile(s, s->tile + tileno, tileno)) < 0)
             return ret;
-        bytestream_put_be32(&psotptr, s->buf - psotptr + 6);
+        if (s->plt && (ret = put_plt(s, sodptr)) < 0)
+            return ret;
+        psot = s->buf - psotptr + 6;
+        bytestream_put_be32(&psotptr, psot);
+        if (s->tlm)
+            update_tlm(s, tileno, psot);
     }
     if (s->buf_end - s->buf < 2)
         return -1;
@@ -1712,6 +1913,42 @@ static int parse_layer_rates(Jpeg2000EncoderContext *s)
     return 0;
 }
 
+/**
+ * parse the precinct sizes, given from the highest resolution level down
+ * The last size is used for all remaining lower levels.
+ */
+static int parse_precincts(Jpeg2000EncoderContext *s)
+{
+    Jpeg2000CodingStyle *codsty = &s->codsty;
+    char *token, *saveptr = NULL;
+    int i, reslevelno = codsty->nreslevels - 1;
+    int w = 0, h = 0;
+
+    if (!s->prec_str)
+        return 0;
+
+    for (token = av_strtok(s->prec_str, ",", &saveptr); token;
+         token = av_strtok(NULL, ",", &saveptr)) {
+        if (reslevelno < 0)
+            return AVERROR_INVALIDDATA;
+        if (av_parse_video_size(&w, &h, token) < 0 ||
+            w < 2 || w > 1 << 15 || (w & (w - 1)) ||
+            h < 2 || h > 1 << 15 || (h & (h - 1)))
+            return AVERROR_INVALIDDATA;
+        codsty->log2_prec_widths [reslevelno] = av_log2(w);
+        codsty->log2_prec_heights[reslevelno] = av_log2(h);
+        reslevelno--;
+    }
+    if (!w)
+        return AVERROR_INVALIDDATA;
+    for (i = reslevelno; i >= 0; i--) {
+        codsty->log2_prec_widths [i] = av_log2(w);
+        codsty->log2_prec_heights[i] = av_log2(h);
+    }
+    codsty->csty |= JPEG2000_CSTY_PREC;
+    return 0;
+}
+
 static av_cold int j2kenc_init(AVCodecContext *avctx)
 {
     static AVOnce init_static_once = AV_ONCE_INIT;
@@ -1736,7 +1973,6 @@ static av_cold int j2kenc_init(AVCodecContext *avctx)
     }
 
     // defaults:
-    // TODO: implement setting non-standard precinct size
     memset(codsty->log2_prec_widths , 15, sizeof(codsty->log2_prec_widths ));
     memset(codsty->log2_prec_heights, 15, sizeof(codsty->log2_prec_heights));
     codsty->nreslevels2decode=
@@ -1745,6 +1981,12 @@ static av_cold int j2kenc_init(AVCodecContext *avctx)
     codsty->log2_cblk_width  = 4;
     codsty->log2_cblk_height = 4;
     codsty->transform        = s->pred ? FF_DWT53 : FF_DWT97_INT;
+    codsty->cblk_style       = s->bypass ? JPEG2000_CBLK_BYPASS : 0;
+
+    if (parse_precincts(s)) {
+        av_log(s, AV_LOG_ERROR, "Invalid precinct sizes \"%s\"\n", s->prec_str);
+        return AVERROR(EINVAL);
+    }
 
     qntsty->nguardbits       = 1;
 
@@ -1787,6 +2029,22 @@ static av_cold int j2kenc_init(AVCodecContext *avctx)
     if ((ret=init_tiles(s)) < 0)
         return ret;
 
+    if (s->plt) {
+        int tileno, compno, reslevelno, max_packets = 0;
+        for (tileno = 0; tileno < s->numXtiles * s->numYtiles; tileno++) {
+            int nb_packets = 0;
+            for (compno = 0; compno < s->ncomponents; compno++)
+                for (reslevelno = 0; reslevelno < codsty->nreslevels; reslevelno++) {
+                    Jpeg2000ResLevel *reslevel = s->tile[tileno].comp[compno].reslevel + reslevelno;
+                    nb_packets += reslevel->num_precincts_x * reslevel->num_precincts_y * s->nlayers;
+                }
+            max_packets = FFMAX(max_packets, nb_packets);
+        }
+        s->packet_lengths = av_calloc(max_packets, sizeof(*s->packet_lengths));
+        if (!s->packet_lengths)
+            return AVERROR(ENOMEM);
+    }
+
     av_log(s->avctx, AV_LOG_DEBUG, "after init\n");
 
     return 0;
@@ -1797,6 +2055,7 @@ static int j2kenc_destroy(AVCodecContext *avctx)
     Jpeg2000EncoderContext *s = avctx->priv_data;
 
     cleanup(s);
+    av_freep(&s->packet_lengths);
     return 0;
 }
 
@@ -1822,6 +2081,10 @@ static const AVOption options[] = {
     { "pcrl",          NULL,                0,                     AV_OPT_TYPE_CONST,  { .i64 = JPEG2000_PGOD_PCRL }, 0,         0,           VE, "prog" },
     { "cprl",          NULL,                0,                     AV_OPT_TYPE_CONST,  { .i64 = JPEG2000_PGOD_CPRL }, 0,         0,           VE, "prog" },
     { "layer_rates",   "Layer Rates",       OFFSET(lr_str),        AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, VE },
+    { "tlm",           "TLM marker",        OFFSET(tlm),           AV_OPT_TYPE_INT,   { .i64 = 0           }, 0,         1,           VE, },
+    { "plt",           "PLT marker",        OFFSET(plt),           AV_OPT_TYPE_INT,   { .i64 = 0           }, 0,         1,           VE, },
+    { "precincts",     "Precinct Sizes",    OFFSET(prec_str),      AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, VE },
+    { "bypass",        "Selective arithmetic coding bypass", OFFSET(bypass), AV_OPT_TYPE_INT, { .i64 = 0   }, 0,         1,           VE, },
     { NULL }
 };
 
@@ -48,12 +48,21 @@ typedef struct MqcState {
 
 /* encoder */
 
-/** initialize the encoder */
-void ff_mqc_initenc(MqcState *mqc, uint8_t *bp);
+/**
+ * Initialize MQ-encoder.
+ * @param mqc   MQ encoder state
+ * @param bp    byte pointer
+ * @param raw   raw mode
+ * @param reset reset states
+ */
+void ff_mqc_initenc(MqcState *mqc, uint8_t *bp, int raw, int reset);
 
 /** code bit d with context cx */
 void ff_mqc_encode(MqcState *mqc, uint8_t *cxstate, int d);
 
+/** terminate the current segment [returns number of bytes encoded] */
+int ff_mqc_flush(MqcState *mqc);
+
 /** flush the encoder [returns number of bytes encoded] */
 int ff_mqc_flush_to(MqcState *mqc, uint8_t *dst, int *dst_len);
 
@@ -68,20 +68,40 @@ static void setbits(MqcState *mqc)
         mqc->c -= 0x8000;
 }
 
-void ff_mqc_initenc(MqcState *mqc, uint8_t *bp)
+void ff_mqc_initenc(MqcState *mqc, uint8_t *bp, int raw, int reset)
 {
-    ff_mqc_init_contexts(mqc);
+    mqc->raw = raw;
+    if (reset)
+        ff_mqc_init_contexts(mqc);
     mqc->a = 0x8000;
     mqc->c = 0;
     mqc->bp = bp-1;
     mqc->bpstart = bp;
-    mqc->ct = 12 + (*mqc->bp == 0xff);
+    if (raw)
+        mqc->ct = 8 - (*mqc->bp == 0xff);
+    else
+        mqc->ct = 12 + (*mqc->bp == 0xff);
+}
+
+static void mqc_encode_bypass(MqcState *mqc, int d)
+{
+    mqc->c = (mqc->c << 1) | d;
+    if (!--mqc->ct) {
+        *++mqc->bp = mqc->c;
+        mqc->c  = 0;
+        mqc->ct = 8 - (*mqc->bp == 0xff);
+    }
 }
 
 void ff_mqc_encode(MqcState *mqc, uint8_t *cxstate, int d)
 {
     int qe;
 
+    if (mqc->raw) {
+        mqc_encode_bypass(mqc, d);
+        return;
+    }
+
     qe = ff_mqc_qe[*cxstate];
     mqc->a -= qe;
     if ((*cxstate & 1) == d){
@@ -104,8 +124,30 @@ void ff_mqc_encode(MqcState *mqc, uint8_t *cxstate, int d)
     }
 }
 
+/**
+ * Write the end of a raw segment to dst: the pending bits padded with
+ * alternating 0 and 1 bits. A segment never ends on 0xff.
+ * @return number of bytes written (0 or 1)
+ */
+static int bypass_tail(MqcState *mqc, uint8_t *dst)
+{
+    if (mqc->ct < 8 || *mqc->bp == 0xff) {
+        *dst = mqc->c << mqc->ct | 0x55 >> (8 - mqc->ct);
+        return 1;
+    }
+    return 0;
+}
+
+static int mqc_flush_bypass(MqcState *mqc)
+{
+    mqc->bp += bypass_tail(mqc, mqc->bp + 1) + 1;
+    return mqc->bp - mqc->bpstart;
+}
+
 static int mqc_flush(MqcState *mqc)
 {
+    if (mqc->raw)
+        return mqc_flush_bypass(mqc);
     setbits(mqc);
     mqc->c = mqc->c << mqc->ct;
     byteout(mqc);
@@ -116,9 +158,21 @@ static int mqc_flush(MqcState *mqc)
     return mqc->bp - mqc->bpstart;
 }
 
+int ff_mqc_flush(MqcState *mqc)
+{
+    // nothing coded yet: the segment can be empty, decoders pad it with 0xff
+    if (!mqc->raw && mqc->bp < mqc->bpstart && !mqc->c && mqc->a == 0x8000)
+        return 0;
+    return mqc_flush(mqc);
+}
+
 int ff_mqc_flush_to(MqcState *mqc, uint8_t *dst, int *dst_len)
 {
     MqcState mqc2 = *mqc;
+    if (mqc->raw) {
+        *dst_len = bypass_tail(mqc, dst);
+        return mqc->bp + 1 - mqc->bpstart + *dst_len;
+    }
     mqc2.bpstart=
     mqc2.bp = dst;
     *mqc2.bp = *mqc->bp;
@@ -127,7 +181,7 @@ int ff_mqc_flush_to(MqcState *mqc, uint8_t *dst, int *dst_len)
     if (mqc->bp < mqc->bpstart) {
         av_assert1(mqc->bpstart - mqc->bp == 1);
         av_assert1(*dst_len > 0);
-        av_assert1(mqc->bp[0] == 0 && dst[0] == 0);
+        av_assert1(mqc->bp[0] == dst[0]);
         (*dst_len) --;
         memmove(dst, dst+1, *dst_len);
         return mqc->bp - mqc->bpstart + 1 + *dst_len;
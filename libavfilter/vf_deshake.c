@@ -88,6 +88,12 @@ static const AVOption deshake_options[] = {
 
 AVFILTER_DEFINE_CLASS(deshake);
 
+typedef struct ThreadData {
+    uint8_t *src1, *src2;
+    int stride;
+    int nb_rows, nb_cols;
+} ThreadData;
+
 static int cmp(const void *a, const void *b)
 {
     return FFDIFFSIGN(*(const double *)a, *(const double *)b);
@@ -225,6 +231,41 @@ static double block_angle(int x, int y, int cx, int cy, IntMotionVector *shift)
            diff;
 }
 
+/**
+ * Find the motion vector of every block with enough contrast in a band of
+ * block rows. Skipped and unmatched blocks are stored as (-1, -1).
+ */
+static int find_motion_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    DeshakeContext *deshake = ctx->priv;
+    const ThreadData *td = arg;
+    const int row_start = (td->nb_rows *  jobnr   ) / nb_jobs;
+    const int row_end   = (td->nb_rows * (jobnr+1)) / nb_jobs;
+    IntMotionVector mv = {0, 0};
+    int row, col, contrast;
+
+    for (row = row_start; row < row_end; row++) {
+        const int y = deshake->ry + row * deshake->blocksize * 2;
+        IntMotionVector *mvs = deshake->mvs + row * td->nb_cols;
+
+        // We use a width of 16 here to match the sad function
+        for (col = 0; col < td->nb_cols; col++) {
+            const int x = deshake->rx + col * 16;
+
+            mvs[col].x = mvs[col].y = -1;
+            // If the contrast is too low, just skip this block as it probably
+            // won't be very useful to us.
+            contrast = block_contrast(td->src2, x, y, td->stride, deshake->blocksize);
+            if (contrast > deshake->contrast) {
+                find_block_motion(deshake, td->src1, td->src2, x, y, td->stride, &mv);
+                mvs[col] = mv;
+            }
+        }
+    }
+
+    return 0;
+}
+
 /**
  * Find the estimated global motion for a scene given the most likely shift
  * for each block in the frame. The global motion is estimated to be the
@@ -232,19 +273,31 @@ static double block_angle(int x, int y, int cx, int cy, IntMotionVector *shift)
  * move one pixel to the right and two pixels down, this would yield a
  * motion vector (1, -2).
  */
-static void find_motion(DeshakeContext *deshake, uint8_t *src1, uint8_t *src2,
-                        int width, int height, int stride, Transform *t)
+static int find_motion(AVFilterContext *ctx, uint8_t *src1, uint8_t *src2,
+                       int width, int height, int stride, Transform *t)
 {
-    int x, y;
-    IntMotionVector mv = {0, 0};
+    DeshakeContext *deshake = ctx->priv;
+    ThreadData td;
+    int x, y, row, col, nb_jobs;
     int count_max_value = 0;
-    int contrast;
+    const int step_y = deshake->blocksize * 2;
+    const int end_x = width  - deshake->rx - 16;
+    const int end_y = height - deshake->ry - step_y;
 
     int pos;
     int center_x = 0, center_y = 0;
     double p_x, p_y;
 
+    td.src1    = src1;
+    td.src2    = src2;
+    td.stride  = stride;
+    td.nb_cols = end_x > deshake->rx ? (end_x - deshake->rx + 15) / 16 : 0;
+    td.nb_rows = end_y > deshake->ry ? (end_y - deshake->ry + step_y - 1) / step_y : 0;
+
     av_fast_malloc(&deshake->angles, &deshake->angles_size, width * height / (16 * deshake->blocksize) * sizeof(*deshake->angles));
+    av_fast_malloc(&deshake->mvs, &deshake->mvs_size, FFMAX(td.nb_rows * td.nb_cols, 1) * sizeof(*deshake->mvs));
+    if (!deshake->mvs)
+        return AVERROR(ENOMEM);
 
     // Reset counts to zero
     for (x = 0; x < deshake->rx * 2 + 1; x++) {
@@ -253,25 +306,30 @@ static void find_motion(DeshakeContext *deshake, uint8_t *src1, uint8_t *src2,
         }
     }
 
+    // Find motion for every block. The less exhaustive search starts from
+    // the previous block's vector when its first pass is empty, so it has
+    // to run in order then.
+    nb_jobs = FFMIN(ff_filter_get_nb_threads(ctx), td.nb_rows);
+    if (deshake->search == SMART_EXHAUSTIVE && (!deshake->rx || !deshake->ry))
+        nb_jobs = 1;
+    if (nb_jobs > 0)
+        ff_filter_execute(ctx, find_motion_slice, &td, NULL, nb_jobs);
+
     pos = 0;
-    // Find motion for every block and store the motion vector in the counts
-    for (y = deshake->ry; y < height - deshake->ry - (deshake->blocksize * 2); y += deshake->blocksize * 2) {
-        // We use a width of 16 here to match the sad function
-        for (x = deshake->rx; x < width - deshake->rx - 16; x += 16) {
-            // If the contrast is too low, just skip this block as it probably
-            // won't be very useful to us.
-            contrast = block_contrast(src2, x, y, stride, deshake->blocksize);
-            if (contrast > deshake->contrast) {
-                //av_log(NULL, AV_LOG_ERROR, "%d\n", contrast);
-                find_block_motion(deshake, src1, src2, x, y, stride, &mv);
-                if (mv.x != -1 && mv.y != -1) {
-                    deshake->counts[mv.x + deshake->rx][mv.y + deshake->ry] += 1;
-                    if (x > deshake->rx && y > deshake->ry)
-                        deshake->angles[pos++] = block_angle(x, y, 0, 0, &mv);
-
-                    center_x += mv.x;
-                    center_y += mv.y;
-                }
+    // Store the motion vectors in the counts, in frame order
+    for (row = 0; row < td.nb_rows; row++) {
+        y = deshake->ry + row * step_y;
+        for (col = 0; col < td.nb_cols; col++) {
+            IntMotionVector *mv = &deshake->mvs[row * td.nb_cols + col];
+
+            x = deshake->rx + col * 16;
+            if (mv->x != -1 && mv->y != -1) {
+                deshake->counts[mv->x + deshake->rx][mv->y + deshake->ry] += 1;
+                if (x > deshake->rx && y > deshake->ry)
+                    deshake->angles[pos++] = block_angle(x, y, 0, 0, mv);
+
+                center_x += mv->x;
+                center_y += mv->y;
             }
         }
     }
@@ -310,6 +368,7 @@ static void find_motion(DeshakeContext *deshake, uint8_t *src1, uint8_t *src2,
     t->angle = av_clipf(t->angle, -0.1, 0.1);
 
     //av_log(NULL, AV_LOG_ERROR, "%d x %d\n", avg->x, avg->y);
+    return 0;
 }
 
 static int deshake_transform_c(AVFilterContext *ctx,
@@ -397,6 +456,8 @@ static av_cold void uninit(AVFilterContext *ctx)
     av_frame_free(&deshake->ref);
     av_freep(&deshake->angles);
     deshake->angles_size = 0;
+    av_freep(&deshake->mvs);
+    deshake->mvs_size = 0;
     if (deshake->fp)
         fclose(deshake->fp);
 }
@@ -431,7 +492,7 @@ static int filter_frame(AVFilterLink *link, AVFrame *in)
 
     if (deshake->cx < 0 || deshake->cy < 0 || deshake->cw < 0 || deshake->ch < 0) {
         // Find the most likely global motion for the current frame
-        find_motion(deshake, (deshake->ref == NULL) ? in->data[0] : deshake->ref->data[0], in->data[0], link->w, link->h, in->linesize[0], &t);
+        ret = find_motion(link->dst, (deshake->ref == NULL) ? in->data[0] : deshake->ref->data[0], in->data[0], link->w, link->h, in->linesize[0], &t);
     } else {
         uint8_t *src1 = (deshake->ref == NULL) ? in->data[0] : deshake->ref->data[0];
         uint8_t *src2 = in->data[0];
@@ -448,7 +509,11 @@ static int filter_frame(AVFilterLink *link, AVFrame *in)
         src1 += deshake->cy * in->linesize[0] + deshake->cx;
         src2 += deshake->cy * in->linesize[0] + deshake->cx;
 
-        find_motion(deshake, src1, src2, deshake->cw, deshake->ch, in->linesize[0], &t);
+        ret = find_motion(link->dst, src1, src2, deshake->cw, deshake->ch, in->linesize[0], &t);
+    }
+    if (ret < 0) {
+        av_frame_free(&in);
+        goto fail;
     }
 
 
@@ -552,4 +617,5 @@ const AVFilter ff_vf_deshake = {
     FILTER_OUTPUTS(deshake_outputs),
     FILTER_PIXFMTS_ARRAY(pix_fmts),
     .priv_class    = &deshake_class,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -162,6 +162,8 @@ typedef struct DrawTextContext {
     int y;                          ///< y position to start drawing text
     int max_glyph_w;                ///< max glyph width
     int max_glyph_h;                ///< max glyph height
+    int ascent, descent;            ///< max glyph ascent and descent
+    int text_w, text_h;             ///< size of the laid out text
     int shadowx, shadowy;
     int borderw;                    ///< border width
     char *fontsize_expr;            ///< expression for fontsize
@@ -186,6 +188,14 @@ typedef struct DrawTextContext {
     FT_Face face;                   ///< freetype font face handle
     FT_Stroker stroker;             ///< freetype stroker handle
     struct AVTreeNode *glyphs;      ///< rendered glyphs, stored using the UTF-32 char code
+    char *layout_text;              ///< expanded text the cached layout was computed for
+    unsigned int layout_fontsize;   ///< font size the cached layout was computed for
+    uint8_t *strip[2];              ///< cached coverage of the text and of its border
+    uint8_t *strip_buf;             ///< buffer holding both coverage strips
+    unsigned int strip_buf_size;
+    int strip_linesize;
+    int strip_x, strip_y;           ///< position of the strips relative to the text
+    int strip_w, strip_h;           ///< size of the strips
     char *x_expr;                   ///< expression for x position
     char *y_expr;                   ///< expression for y position
     AVExpr *x_pexpr, *y_pexpr;      ///< parsed expressions for x and y
@@ -849,6 +859,10 @@ static av_cold void uninit(AVFilterContext *ctx)
     av_freep(&s->positions);
     s->nb_positions = 0;
 
+    av_freep(&s->layout_text);
+    av_freep(&s->strip_buf);
+    s->strip_buf_size = 0;
+
     av_tree_enumerate(s->glyphs, NULL, NULL, glyph_enu_free);
     av_tree_destroy(s->glyphs);
     s->glyphs = NULL;
@@ -1312,52 +1326,225 @@ static int expand_text(AVFilterContext *ctx, char *text, AVBPrint *bp)
     return 0;
 }
 
-static int draw_glyphs(DrawTextContext *s, AVFrame *frame,
-                       int width, int height,
-                       FFDrawColor *color,
-                       int x, int y, int borderw)
+/**
+ * Composite a glyph bitmap into an 8 bit coverage mask.
+ */
+static void blend_coverage(uint8_t *dst, int dst_linesize, const FT_Bitmap *bitmap)
+{
+    int x, y;
+
+    for (y = 0; y < bitmap->rows; y++) {
+        const uint8_t *src = bitmap->buffer + y * bitmap->pitch;
+
+        for (x = 0; x < bitmap->width; x++) {
+            unsigned a = bitmap->pixel_mode == FT_PIXEL_MODE_MONO ?
+                         (src[x >> 3] >> (7 - (x & 7)) & 1) * 255 : src[x];
+            dst[x] = 255 - ((255 - dst[x]) * (255 - a) + 127) / 255;
+        }
+        dst += dst_linesize;
+    }
+}
+
+/**
+ * Render the laid out glyphs, and their border if any, into coverage
+ * strips spanning the union of the glyph bitmaps.
+ */
+static int render_strips(DrawTextContext *s)
 {
     char *text = s->expanded_text.str;
+    int nb_layers = s->borderw ? 2 : 1;
+    int x0 = INT_MAX, y0 = INT_MAX, x1 = INT_MIN, y1 = INT_MIN;
     uint32_t code = 0;
-    int i, x1, y1;
+    int64_t size;
+    int i, l, pass;
     uint8_t *p;
     Glyph *glyph = NULL;
 
+    for (pass = 0; pass < 2; pass++) {
+        for (i = 0, p = text; *p; i++) {
+            Glyph dummy = { 0 };
+            GET_UTF8(code, *p ? *p++ : 0, code = 0xfffd; goto continue_on_invalid;);
+continue_on_invalid:
+
+            /* skip new line chars, just go to new line */
+            if (code == '\n' || code == '\r' || code == '\t')
+                continue;
+
+            dummy.code = code;
+            dummy.fontsize = s->fontsize;
+            glyph = av_tree_find(s->glyphs, &dummy, glyph_cmp, NULL);
+
+            if (glyph->bitmap.pixel_mode != FT_PIXEL_MODE_MONO &&
+                glyph->bitmap.pixel_mode != FT_PIXEL_MODE_GRAY)
+                return AVERROR(EINVAL);
+
+            for (l = 0; l < nb_layers; l++) {
+                const FT_Bitmap *bitmap = l ? &glyph->border_bitmap : &glyph->bitmap;
+                int bx = s->positions[i].x - (l ? s->borderw : 0);
+                int by = s->positions[i].y - (l ? s->borderw : 0);
+
+                if (!bitmap->width || !bitmap->rows)
+                    continue;
+
+                if (!pass) {
+                    x0 = FFMIN(x0, bx);
+                    y0 = FFMIN(y0, by);
+                    x1 = FFMAX(x1, bx + (int)bitmap->width);
+                    y1 = FFMAX(y1, by + (int)bitmap->rows);
+                } else {
+                    blend_coverage(s->strip[l] + (by - s->strip_y) * s->strip_linesize +
+                                   bx - s->strip_x, s->strip_linesize, bitmap);
+                }
+            }
+        }
+
+        if (!pass) {
+            s->strip_w = s->strip_h = 0;
+            if (x0 >= x1)
+                return 0;
+
+            s->strip_linesize = FFALIGN(x1 - x0, 32);
+            size = (int64_t)s->strip_linesize * (y1 - y0);
+            if (size * nb_layers > INT_MAX)
+                return AVERROR(EINVAL);
+
+            av_fast_malloc(&s->strip_buf, &s->strip_buf_size, size * nb_layers);
+            if (!s->strip_buf)
+                return AVERROR(ENOMEM);
+            memset(s->strip_buf, 0, size * nb_layers);
+
+            s->strip[0] = s->strip_buf;
+            s->strip[1] = s->strip_buf + size;
+            s->strip_x  = x0;
+            s->strip_y  = y0;
+            s->strip_w  = x1 - x0;
+            s->strip_h  = y1 - y0;
+        }
+    }
+
+    return 0;
+}
+
+static void draw_strip(DrawTextContext *s, AVFrame *frame,
+                       int width, int height,
+                       FFDrawColor *color,
+                       int x, int y, int layer)
+{
+    if (!s->strip_w)
+        return;
+
+    ff_blend_mask(&s->dc, color,
+                  frame->data, frame->linesize, width, height,
+                  s->strip[layer], s->strip_linesize,
+                  s->strip_w, s->strip_h, 3, 0,
+                  s->x + x + s->strip_x, s->y + y + s->strip_y);
+}
+
+/**
+ * Load the glyphs of the expanded text, compute their positions and
+ * render them into the coverage strips. The result only depends on the
+ * text and the font size, so it is kept until either of them changes.
+ */
+static int layout_text(AVFilterContext *ctx)
+{
+    DrawTextContext *s = ctx->priv;
+    char *text = s->expanded_text.str;
+    uint32_t code = 0, prev_code = 0;
+    int x = 0, y = 0, i = 0, ret;
+    int max_text_line_w = 0, len;
+    uint8_t *p;
+    int y_min = 32000, y_max = -32000;
+    int x_min = 32000, x_max = -32000;
+    FT_Vector delta;
+    Glyph *glyph = NULL, *prev_glyph = NULL;
+    Glyph dummy = { 0 };
+
+    av_freep(&s->layout_text);
+
+    if ((len = s->expanded_text.len) > s->nb_positions) {
+        if (!(s->positions =
+              av_realloc(s->positions, len*sizeof(*s->positions))))
+            return AVERROR(ENOMEM);
+        s->nb_positions = len;
+    }
+
+    /* load and cache glyphs */
     for (i = 0, p = text; *p; i++) {
-        FT_Bitmap bitmap;
-        Glyph dummy = { 0 };
         GET_UTF8(code, *p ? *p++ : 0, code = 0xfffd; goto continue_on_invalid;);
 continue_on_invalid:
 
-        /* skip new line chars, just go to new line */
-        if (code == '\n' || code == '\r' || code == '\t')
+        /* get glyph */
+        dummy.code = code;
+        dummy.fontsize = s->fontsize;
+        glyph = av_tree_find(s->glyphs, &dummy, glyph_cmp, NULL);
+        if (!glyph) {
+            ret = load_glyph(ctx, &glyph, code);
+            if (ret < 0)
+                return ret;
+        }
+
+        y_min = FFMIN(glyph->bbox.yMin, y_min);
+        y_max = FFMAX(glyph->bbox.yMax, y_max);
+        x_min = FFMIN(glyph->bbox.xMin, x_min);
+        x_max = FFMAX(glyph->bbox.xMax, x_max);
+    }
+    s->max_glyph_h = y_max - y_min;
+    s->max_glyph_w = x_max - x_min;
+
+    /* compute and save position for each glyph */
+    glyph = NULL;
+    for (i = 0, p = text; *p; i++) {
+        GET_UTF8(code, *p ? *p++ : 0, code = 0xfffd; goto continue_on_invalid2;);
+continue_on_invalid2:
+
+        /* skip the \n in the sequence \r\n */
+        if (prev_code == '\r' && code == '\n')
             continue;
 
+        prev_code = code;
+        if (is_newline(code)) {
+
+            max_text_line_w = FFMAX(max_text_line_w, x);
+            y += s->max_glyph_h + s->line_spacing;
+            x = 0;
+            continue;
+        }
+
+        /* get glyph */
+        prev_glyph = glyph;
         dummy.code = code;
         dummy.fontsize = s->fontsize;
         glyph = av_tree_find(s->glyphs, &dummy, glyph_cmp, NULL);
 
-        bitmap = borderw ? glyph->border_bitmap : glyph->bitmap;
+        /* kerning */
+        if (s->use_kerning && prev_glyph && glyph->code) {
+            FT_Get_Kerning(s->face, prev_glyph->code, glyph->code,
+                           ft_kerning_default, &delta);
+            x += delta.x >> 6;
+        }
 
-        if (glyph->bitmap.pixel_mode != FT_PIXEL_MODE_MONO &&
-            glyph->bitmap.pixel_mode != FT_PIXEL_MODE_GRAY)
-            return AVERROR(EINVAL);
+        /* save position */
+        s->positions[i].x = x + glyph->bitmap_left;
+        s->positions[i].y = y - glyph->bitmap_top + y_max;
+        if (code == '\t') x  = (x / s->tabsize + 1)*s->tabsize;
+        else              x += glyph->advance;
+    }
 
-        x1 = s->positions[i].x+s->x+x - borderw;
-        y1 = s->positions[i].y+s->y+y - borderw;
+    s->text_w  = FFMAX(x, max_text_line_w);
+    s->text_h  = y + s->max_glyph_h;
+    s->ascent  = y_max;
+    s->descent = y_min;
 
-        ff_blend_mask(&s->dc, color,
-                      frame->data, frame->linesize, width, height,
-                      bitmap.buffer, bitmap.pitch,
-                      bitmap.width, bitmap.rows,
-                      bitmap.pixel_mode == FT_PIXEL_MODE_MONO ? 0 : 3,
-                      0, x1, y1);
-    }
+    if ((ret = render_strips(s)) < 0)
+        return ret;
+
+    if (!(s->layout_text = av_strdup(text)))
+        return AVERROR(ENOMEM);
+    s->layout_fontsize = s->fontsize;
 
     return 0;
 }
 
-
 static void update_color_with_alpha(DrawTextContext *s, FFDrawColor *color, const FFDrawColor incolor)
 {
     *color = incolor;
@@ -1386,17 +1573,8 @@ static int draw_text(AVFilterContext *ctx, AVFrame *frame,
     DrawTextContext *s = ctx->priv;
     AVFilterLink *inlink = ctx->inputs[0];
 
-    uint32_t code = 0, prev_code = 0;
-    int x = 0, y = 0, i = 0, ret;
-    int max_text_line_w = 0, len;
+    int ret;
     int box_w, box_h;
-    char *text;
-    uint8_t *p;
-    int y_min = 32000, y_max = -32000;
-    int x_min = 32000, x_max = -32000;
-    FT_Vector delta;
-    Glyph *glyph = NULL, *prev_glyph = NULL;
-    Glyph dummy = { 0 };
 
     time_t now = time(0);
     struct tm ltime;
@@ -1435,13 +1613,6 @@ static int draw_text(AVFilterContext *ctx, AVFrame *frame,
 
     if (!av_bprint_is_complete(bp))
         return AVERROR(ENOMEM);
-    text = s->expanded_text.str;
-    if ((len = s->expanded_text.len) > s->nb_positions) {
-        if (!(s->positions =
-              av_realloc(s->positions, len*sizeof(*s->positions))))
-            return AVERROR(ENOMEM);
-        s->nb_positions = len;
-    }
 
     if (s->fontcolor_expr[0]) {
         /* If expression is set, evaluate and replace the static value */
@@ -1457,83 +1628,22 @@ static int draw_text(AVFilterContext *ctx, AVFrame *frame,
         ff_draw_color(&s->dc, &s->fontcolor, s->fontcolor.rgba);
     }
 
-    x = 0;
-    y = 0;
-
     if ((ret = update_fontsize(ctx)) < 0)
         return ret;
 
-    /* load and cache glyphs */
-    for (i = 0, p = text; *p; i++) {
-        GET_UTF8(code, *p ? *p++ : 0, code = 0xfffd; goto continue_on_invalid;);
-continue_on_invalid:
-
-        /* get glyph */
-        dummy.code = code;
-        dummy.fontsize = s->fontsize;
-        glyph = av_tree_find(s->glyphs, &dummy, glyph_cmp, NULL);
-        if (!glyph) {
-            ret = load_glyph(ctx, &glyph, code);
-            if (ret < 0)
-                return ret;
-        }
-
-        y_min = FFMIN(glyph->bbox.yMin, y_min);
-        y_max = FFMAX(glyph->bbox.yMax, y_max);
-        x_min = FFMIN(glyph->bbox.xMin, x_min);
-        x_max = FFMAX(glyph->bbox.xMax, x_max);
-    }
-    s->max_glyph_h = y_max - y_min;
-    s->max_glyph_w = x_max - x_min;
-
-    /* compute and save position for each glyph */
-    glyph = NULL;
-    for (i = 0, p = text; *p; i++) {
-        GET_UTF8(code, *p ? *p++ : 0, code = 0xfffd; goto continue_on_invalid2;);
-continue_on_invalid2:
-
-        /* skip the \n in the sequence \r\n */
-        if (prev_code == '\r' && code == '\n')
-            continue;
-
-        prev_code = code;
-        if (is_newline(code)) {
-
-            max_text_line_w = FFMAX(max_text_line_w, x);
-            y += s->max_glyph_h + s->line_spacing;
-            x = 0;
-            continue;
-        }
-
-        /* get glyph */
-        prev_glyph = glyph;
-        dummy.code = code;
-        dummy.fontsize = s->fontsize;
-        glyph = av_tree_find(s->glyphs, &dummy, glyph_cmp, NULL);
-
-        /* kerning */
-        if (s->use_kerning && prev_glyph && glyph->code) {
-            FT_Get_Kerning(s->face, prev_glyph->code, glyph->code,
-                           ft_kerning_default, &delta);
-            x += delta.x >> 6;
-        }
-
-        /* save position */
-        s->positions[i].x = x + glyph->bitmap_left;
-        s->positions[i].y = y - glyph->bitmap_top + y_max;
-        if (code == '\t') x  = (x / s->tabsize + 1)*s->tabsize;
-        else              x += glyph->advance;
+    if (!s->layout_text || s->layout_fontsize != s->fontsize ||
+        strcmp(s->layout_text, s->expanded_text.str)) {
+        if ((ret = layout_text(ctx)) < 0)
+            return ret;
     }
 
-    max_text_line_w = FFMAX(x, max_text_line_w);
-
-    s->var_values[VAR_TW] = s->var_values[VAR_TEXT_W] = max_text_line_w;
-    s->var_values[VAR_TH] = s->var_values[VAR_TEXT_H] = y + s->max_glyph_h;
+    s->var_values[VAR_TW] = s->var_values[VAR_TEXT_W] = s->text_w;
+    s->var_values[VAR_TH] = s->var_values[VAR_TEXT_H] = s->text_h;
 
     s->var_values[VAR_MAX_GLYPH_W] = s->max_glyph_w;
     s->var_values[VAR_MAX_GLYPH_H] = s->max_glyph_h;
-    s->var_values[VAR_MAX_GLYPH_A] = s->var_values[VAR_ASCENT ] = y_max;
-    s->var_values[VAR_MAX_GLYPH_D] = s->var_values[VAR_DESCENT] = y_min;
+    s->var_values[VAR_MAX_GLYPH_A] = s->var_values[VAR_ASCENT ] = s->ascent;
+    s->var_values[VAR_MAX_GLYPH_D] = s->var_values[VAR_DESCENT] = s->descent;
 
     s->var_values[VAR_LINE_H] = s->var_values[VAR_LH] = s->max_glyph_h;
 
@@ -1553,8 +1663,8 @@ continue_on_invalid2:
     update_color_with_alpha(s, &bordercolor, s->bordercolor);
     update_color_with_alpha(s, &boxcolor   , s->boxcolor   );
 
-    box_w = max_text_line_w;
-    box_h = y + s->max_glyph_h;
+    box_w = s->text_w;
+    box_h = s->text_h;
 
     if (s->fix_bounds) {
 
@@ -1589,20 +1699,13 @@ continue_on_invalid2:
                            s->x - s->boxborderw, s->y - s->boxborderw,
                            box_w + s->boxborderw * 2, box_h + s->boxborderw * 2);
 
-    if (s->shadowx || s->shadowy) {
-        if ((ret = draw_glyphs(s, frame, width, height,
-                               &shadowcolor, s->shadowx, s->shadowy, 0)) < 0)
-            return ret;
-    }
+    if (s->shadowx || s->shadowy)
+        draw_strip(s, frame, width, height, &shadowcolor, s->shadowx, s->shadowy, 0);
 
-    if (s->borderw) {
-        if ((ret = draw_glyphs(s, frame, width, height,
-                               &bordercolor, 0, 0, s->borderw)) < 0)
-            return ret;
-    }
-    if ((ret = draw_glyphs(s, frame, width, height,
-                           &fontcolor, 0, 0, 0)) < 0)
-        return ret;
+    if (s->borderw)
+        draw_strip(s, frame, width, height, &bordercolor, 0, 0, 1);
+
+    draw_strip(s, frame, width, height, &fontcolor, 0, 0, 0);
 
     return 0;
 }
@@ -106,11 +106,28 @@ typedef struct FieldMatchContext {
     int map_linesize[4];
     uint8_t *cmask_data[4];
     int cmask_linesize[4];
-    int *c_array;
+    int *c_array;                   ///< per job block combing counts
+    int c_array_size;
     int tpitchy, tpitchuv;
     uint8_t *tbuffer;
+
+    int nb_threads;
+    uint64_t (*job_sums)[6];        ///< per job partial field differences
 } FieldMatchContext;
 
+typedef struct ThreadData {
+    const AVFrame *f1, *f2;
+
+    /* compare_fields() state for the current plane */
+    int plane, width, height;
+    int y0a, y1a, startx, stopx;
+    const uint8_t *dprvp, *dnxtp;   ///< fields the diff map is built from
+    int dprv_linesize, dnxt_linesize;
+    uint8_t *dmapp;                 ///< diff map lines built from them
+    const uint8_t *mapp, *srcf, *prvpf, *nxtpf;
+    int map_linesize, srcf_linesize, prvf_linesize, nxtf_linesize;
+} ThreadData;
+
 #define OFFSET(x) offsetof(FieldMatchContext, x)
 #define FLAGS AV_OPT_FLAG_VIDEO_PARAM|AV_OPT_FLAG_FILTERING_PARAM
 
@@ -163,23 +180,42 @@ static int get_height(const FieldMatchContext *fm, const AVFrame *f, int plane,
     return plane ? AV_CEIL_RSHIFT(f->height, fm->vsub[input]) : f->height;
 }
 
-static int64_t luma_abs_diff(const AVFrame *f1, const AVFrame *f2)
+static int luma_abs_diff_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
+    FieldMatchContext *fm = ctx->priv;
+    const ThreadData *td = arg;
     int x, y;
-    const uint8_t *srcp1 = f1->data[0];
-    const uint8_t *srcp2 = f2->data[0];
-    const int src1_linesize = f1->linesize[0];
-    const int src2_linesize = f2->linesize[0];
-    const int width  = f1->width;
-    const int height = f1->height;
+    const int src1_linesize = td->f1->linesize[0];
+    const int src2_linesize = td->f2->linesize[0];
+    const int width  = td->f1->width;
+    const int height = td->f1->height;
+    const int slice_start = (height *  jobnr   ) / nb_jobs;
+    const int slice_end   = (height * (jobnr+1)) / nb_jobs;
+    const uint8_t *srcp1 = td->f1->data[0] + slice_start * src1_linesize;
+    const uint8_t *srcp2 = td->f2->data[0] + slice_start * src2_linesize;
     int64_t acc = 0;
 
-    for (y = 0; y < height; y++) {
+    for (y = slice_start; y < slice_end; y++) {
         for (x = 0; x < width; x++)
             acc += abs(srcp1[x] - srcp2[x]);
         srcp1 += src1_linesize;
         srcp2 += src2_linesize;
     }
+    fm->job_sums[jobnr][0] = acc;
+    return 0;
+}
+
+static int64_t luma_abs_diff(AVFilterContext *ctx, const AVFrame *f1, const AVFrame *f2)
+{
+    FieldMatchContext *fm = ctx->priv;
+    ThreadData td = { .f1 = f1, .f2 = f2 };
+    const int nb_jobs = FFMAX(1, FFMIN(fm->nb_threads, f1->height));
+    int64_t acc = 0;
+    int i;
+
+    ff_filter_execute(ctx, luma_abs_diff_slice, &td, NULL, nb_jobs);
+    for (i = 0; i < nb_jobs; i++)
+        acc += fm->job_sums[i][0];
     return acc;
 }
 
@@ -193,25 +229,31 @@ static void fill_buf(uint8_t *data, int w, int h, int linesize, uint8_t v)
     }
 }
 
-static int calc_combed_score(const FieldMatchContext *fm, const AVFrame *src)
+static int combed_mask_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
-    int x, y, plane, max_v = 0;
+    const FieldMatchContext *fm = ctx->priv;
+    const AVFrame *src = ((const ThreadData *)arg)->f1;
+    int x, y, plane;
     const int cthresh = fm->cthresh;
     const int cthresh6 = cthresh * 6;
 
     for (plane = 0; plane < (fm->chroma ? 3 : 1); plane++) {
-        const uint8_t *srcp = src->data[plane];
         const int src_linesize = src->linesize[plane];
         const int width  = get_width (fm, src, plane, INPUT_MAIN);
         const int height = get_height(fm, src, plane, INPUT_MAIN);
-        uint8_t *cmkp = fm->cmask_data[plane];
         const int cmk_linesize = fm->cmask_linesize[plane];
+        const int slice_start = (height *  jobnr   ) / nb_jobs;
+        const int slice_end   = (height * (jobnr+1)) / nb_jobs;
 
-        if (cthresh < 0) {
-            fill_buf(cmkp, width, height, cmk_linesize, 0xff);
-            continue;
-        }
-        fill_buf(cmkp, width, height, cmk_linesize, 0);
+        for (y = slice_start; y < slice_end; y++) {
+            const uint8_t *srcp = src->data[plane] + y * src_linesize;
+            uint8_t *cmkp = fm->cmask_data[plane] + y * cmk_linesize;
+
+            if (cthresh < 0) {
+                memset(cmkp, 0xff, width);
+                continue;
+            }
+            memset(cmkp, 0, width);
 
         /* [1 -3 4 -3 1] vertical filter */
 #define FILTER(xm2, xm1, xp1, xp2) \
@@ -219,55 +261,164 @@ static int calc_combed_score(const FieldMatchContext *fm, const AVFrame *src)
              -3 * (srcp[x + (xm1)*src_linesize] + srcp[x + (xp1)*src_linesize]) \
              +    (srcp[x + (xm2)*src_linesize] + srcp[x + (xp2)*src_linesize])) > cthresh6
 
-        /* first line */
-        for (x = 0; x < width; x++) {
-            const int s1 = abs(srcp[x] - srcp[x + src_linesize]);
-            if (s1 > cthresh && FILTER(2, 1, 1, 2))
-                cmkp[x] = 0xff;
-        }
-        srcp += src_linesize;
-        cmkp += cmk_linesize;
-
-        /* second line */
-        for (x = 0; x < width; x++) {
-            const int s1 = abs(srcp[x] - srcp[x - src_linesize]);
-            const int s2 = abs(srcp[x] - srcp[x + src_linesize]);
-            if (s1 > cthresh && s2 > cthresh && FILTER(2, -1, 1, 2))
-                cmkp[x] = 0xff;
-        }
-        srcp += src_linesize;
-        cmkp += cmk_linesize;
-
-        /* all lines minus first two and last two */
-        for (y = 2; y < height-2; y++) {
-            for (x = 0; x < width; x++) {
-                const int s1 = abs(srcp[x] - srcp[x - src_linesize]);
-                const int s2 = abs(srcp[x] - srcp[x + src_linesize]);
-                if (s1 > cthresh && s2 > cthresh && FILTER(-2, -1, 1, 2))
-                    cmkp[x] = 0xff;
+            if (y == 0) {
+                /* first line */
+                for (x = 0; x < width; x++) {
+                    const int s1 = abs(srcp[x] - srcp[x + src_linesize]);
+                    if (s1 > cthresh && FILTER(2, 1, 1, 2))
+                        cmkp[x] = 0xff;
+                }
+            } else if (y == 1) {
+                /* second line */
+                for (x = 0; x < width; x++) {
+                    const int s1 = abs(srcp[x] - srcp[x - src_linesize]);
+                    const int s2 = abs(srcp[x] - srcp[x + src_linesize]);
+                    if (s1 > cthresh && s2 > cthresh && FILTER(2, -1, 1, 2))
+                        cmkp[x] = 0xff;
+                }
+            } else if (y < height - 2) {
+                /* all lines minus first two and last two */
+                for (x = 0; x < width; x++) {
+                    const int s1 = abs(srcp[x] - srcp[x - src_linesize]);
+                    const int s2 = abs(srcp[x] - srcp[x + src_linesize]);
+                    if (s1 > cthresh && s2 > cthresh && FILTER(-2, -1, 1, 2))
+                        cmkp[x] = 0xff;
+                }
+            } else if (y == height - 2) {
+                /* before-last line */
+                for (x = 0; x < width; x++) {
+                    const int s1 = abs(srcp[x] - srcp[x - src_linesize]);
+                    const int s2 = abs(srcp[x] - srcp[x + src_linesize]);
+                    if (s1 > cthresh && s2 > cthresh && FILTER(-2, -1, 1, -2))
+                        cmkp[x] = 0xff;
+                }
+            } else {
+                /* last line */
+                for (x = 0; x < width; x++) {
+                    const int s1 = abs(srcp[x] - srcp[x - src_linesize]);
+                    if (s1 > cthresh && FILTER(-2, -1, -1, -2))
+                        cmkp[x] = 0xff;
+                }
             }
-            srcp += src_linesize;
-            cmkp += cmk_linesize;
         }
+    }
+
+    return 0;
+}
+
+/**
+ * Count the combed pixels of each block of the luma combing mask. Each job
+ * fills its own c_array from a band of half-block rows.
+ */
+static int combed_count_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    const FieldMatchContext *fm = ctx->priv;
+    const AVFrame *src = ((const ThreadData *)arg)->f1;
+    int x, y;
+    const int blockx = fm->blockx;
+    const int blocky = fm->blocky;
+    const int xhalf = blockx/2;
+    const int yhalf = blocky/2;
+    const int cmk_linesize = fm->cmask_linesize[0];
+    const uint8_t *cmkp;
+    const int width  = src->width;
+    const int height = src->height;
+    const int xblocks = ((width+xhalf)/blockx) + 1;
+    const int xblocks4 = xblocks<<2;
+    const int yblocks = ((height+yhalf)/blocky) + 1;
+    int *c_array = fm->c_array + jobnr * fm->c_array_size;
+    const int arraysize = (xblocks*yblocks)<<2;
+    int      heighta = (height/(blocky/2))*(blocky/2);
+    const int widtha = (width /(blockx/2))*(blockx/2);
+    int nb_steps, step_start, step_end;
+    if (heighta == height)
+        heighta = height - yhalf;
+    nb_steps   = FFMAX((heighta - 1) / yhalf, 0);
+    step_start = (nb_steps *  jobnr   ) / nb_jobs;
+    step_end   = (nb_steps * (jobnr+1)) / nb_jobs;
+    memset(c_array, 0, arraysize * sizeof(*c_array));
+
+#define C_ARRAY_ADD(v) do {                         \
+    const int box1 = (x / blockx) * 4;              \
+    const int box2 = ((x + xhalf) / blockx) * 4;    \
+    c_array[temp1 + box1    ] += v;                 \
+    c_array[temp1 + box2 + 1] += v;                 \
+    c_array[temp2 + box1 + 2] += v;                 \
+    c_array[temp2 + box2 + 3] += v;                 \
+} while (0)
+
+#define VERTICAL_HALF(y_start, y_end) do {                                  \
+    for (y = y_start; y < y_end; y++) {                                     \
+        const int temp1 = (y / blocky) * xblocks4;                          \
+        const int temp2 = ((y + yhalf) / blocky) * xblocks4;                \
+        for (x = 0; x < width; x++)                                         \
+            if (cmkp[x - cmk_linesize] == 0xff &&                           \
+                cmkp[x               ] == 0xff &&                           \
+                cmkp[x + cmk_linesize] == 0xff)                             \
+                C_ARRAY_ADD(1);                                             \
+        cmkp += cmk_linesize;                                               \
+    }                                                                       \
+} while (0)
+
+    if (jobnr == 0) {
+        cmkp = fm->cmask_data[0] + cmk_linesize;
+        VERTICAL_HALF(1, yhalf);
+    }
 
-        /* before-last line */
-        for (x = 0; x < width; x++) {
-            const int s1 = abs(srcp[x] - srcp[x - src_linesize]);
-            const int s2 = abs(srcp[x] - srcp[x + src_linesize]);
-            if (s1 > cthresh && s2 > cthresh && FILTER(-2, -1, 1, -2))
-                cmkp[x] = 0xff;
+    cmkp = fm->cmask_data[0] + (yhalf + step_start * yhalf) * cmk_linesize;
+    for (y = yhalf + step_start * yhalf; y < yhalf + step_end * yhalf; y += yhalf) {
+        const int temp1 = (y / blocky) * xblocks4;
+        const int temp2 = ((y + yhalf) / blocky) * xblocks4;
+
+        for (x = 0; x < widtha; x += xhalf) {
+            const uint8_t *cmkp_tmp = cmkp + x;
+            int u, v, sum = 0;
+            for (u = 0; u < yhalf; u++) {
+                for (v = 0; v < xhalf; v++)
+                    if (cmkp_tmp[v - cmk_linesize] == 0xff &&
+                        cmkp_tmp[v               ] == 0xff &&
+                        cmkp_tmp[v + cmk_linesize] == 0xff)
+                        sum++;
+                cmkp_tmp += cmk_linesize;
+            }
+            if (sum)
+                C_ARRAY_ADD(sum);
         }
-        srcp += src_linesize;
-        cmkp += cmk_linesize;
-
-        /* last line */
-        for (x = 0; x < width; x++) {
-            const int s1 = abs(srcp[x] - srcp[x - src_linesize]);
-            if (s1 > cthresh && FILTER(-2, -1, -1, -2))
-                cmkp[x] = 0xff;
+
+        for (x = widtha; x < width; x++) {
+            const uint8_t *cmkp_tmp = cmkp + x;
+            int u, sum = 0;
+            for (u = 0; u < yhalf; u++) {
+                if (cmkp_tmp[-cmk_linesize] == 0xff &&
+                    cmkp_tmp[            0] == 0xff &&
+                    cmkp_tmp[ cmk_linesize] == 0xff)
+                    sum++;
+                cmkp_tmp += cmk_linesize;
+            }
+            if (sum)
+                C_ARRAY_ADD(sum);
         }
+
+        cmkp += cmk_linesize * yhalf;
     }
 
+    if (jobnr == nb_jobs - 1) {
+        cmkp = fm->cmask_data[0] + (yhalf + nb_steps * yhalf) * cmk_linesize;
+        VERTICAL_HALF(heighta, height - 1);
+    }
+
+    return 0;
+}
+
+static int calc_combed_score(AVFilterContext *ctx, const AVFrame *src)
+{
+    const FieldMatchContext *fm = ctx->priv;
+    ThreadData td = { .f1 = src };
+    int x, y, max_v = 0, nb_jobs;
+
+    nb_jobs = FFMAX(1, FFMIN(fm->nb_threads, src->height >> 2));
+    ff_filter_execute(ctx, combed_mask_slice, &td, NULL, nb_jobs);
+
     if (fm->chroma) {
         uint8_t *cmkp  = fm->cmask_data[0];
         uint8_t *cmkpU = fm->cmask_data[1];
@@ -302,90 +453,20 @@ static int calc_combed_score(const FieldMatchContext *fm, const AVFrame *src)
     }
 
     {
-        const int blockx = fm->blockx;
-        const int blocky = fm->blocky;
-        const int xhalf = blockx/2;
-        const int yhalf = blocky/2;
-        const int cmk_linesize = fm->cmask_linesize[0];
-        const uint8_t *cmkp    = fm->cmask_data[0] + cmk_linesize;
-        const int width  = src->width;
-        const int height = src->height;
-        const int xblocks = ((width+xhalf)/blockx) + 1;
-        const int xblocks4 = xblocks<<2;
-        const int yblocks = ((height+yhalf)/blocky) + 1;
-        int *c_array = fm->c_array;
+        const int xblocks = ((src->width  + fm->blockx/2) / fm->blockx) + 1;
+        const int yblocks = ((src->height + fm->blocky/2) / fm->blocky) + 1;
         const int arraysize = (xblocks*yblocks)<<2;
-        int      heighta = (height/(blocky/2))*(blocky/2);
-        const int widtha = (width /(blockx/2))*(blockx/2);
-        if (heighta == height)
-            heighta = height - yhalf;
-        memset(c_array, 0, arraysize * sizeof(*c_array));
-
-#define C_ARRAY_ADD(v) do {                         \
-    const int box1 = (x / blockx) * 4;              \
-    const int box2 = ((x + xhalf) / blockx) * 4;    \
-    c_array[temp1 + box1    ] += v;                 \
-    c_array[temp1 + box2 + 1] += v;                 \
-    c_array[temp2 + box1 + 2] += v;                 \
-    c_array[temp2 + box2 + 3] += v;                 \
-} while (0)
-
-#define VERTICAL_HALF(y_start, y_end) do {                                  \
-    for (y = y_start; y < y_end; y++) {                                     \
-        const int temp1 = (y / blocky) * xblocks4;                          \
-        const int temp2 = ((y + yhalf) / blocky) * xblocks4;                \
-        for (x = 0; x < width; x++)                                         \
-            if (cmkp[x - cmk_linesize] == 0xff &&                           \
-                cmkp[x               ] == 0xff &&                           \
-                cmkp[x + cmk_linesize] == 0xff)                             \
-                C_ARRAY_ADD(1);                                             \
-        cmkp += cmk_linesize;                                               \
-    }                                                                       \
-} while (0)
-
-        VERTICAL_HALF(1, yhalf);
-
-        for (y = yhalf; y < heighta; y += yhalf) {
-            const int temp1 = (y / blocky) * xblocks4;
-            const int temp2 = ((y + yhalf) / blocky) * xblocks4;
-
-            for (x = 0; x < widtha; x += xhalf) {
-                const uint8_t *cmkp_tmp = cmkp + x;
-                int u, v, sum = 0;
-                for (u = 0; u < yhalf; u++) {
-                    for (v = 0; v < xhalf; v++)
-                        if (cmkp_tmp[v - cmk_linesize] == 0xff &&
-                            cmkp_tmp[v               ] == 0xff &&
-                            cmkp_tmp[v + cmk_linesize] == 0xff)
-                            sum++;
-                    cmkp_tmp += cmk_linesize;
-                }
-                if (sum)
-                    C_ARRAY_ADD(sum);
-            }
 
-            for (x = widtha; x < width; x++) {
-                const uint8_t *cmkp_tmp = cmkp + x;
-                int u, sum = 0;
-                for (u = 0; u < yhalf; u++) {
-                    if (cmkp_tmp[-cmk_linesize] == 0xff &&
-                        cmkp_tmp[            0] == 0xff &&
-                        cmkp_tmp[ cmk_linesize] == 0xff)
-                        sum++;
-                    cmkp_tmp += cmk_linesize;
-                }
-                if (sum)
-                    C_ARRAY_ADD(sum);
-            }
+        nb_jobs = FFMAX(1, FFMIN(fm->nb_threads, src->height / FFMAX(fm->blocky/2, 1)));
+        ff_filter_execute(ctx, combed_count_slice, &td, NULL, nb_jobs);
 
-            cmkp += cmk_linesize * yhalf;
+        for (x = 0; x < arraysize; x++) {
+            int sum = 0;
+            for (y = 0; y < nb_jobs; y++)
+                sum += fm->c_array[y * fm->c_array_size + x];
+            if (sum > max_v)
+                max_v = sum;
         }
-
-        VERTICAL_HALF(heighta, height - 1);
-
-        for (x = 0; x < arraysize; x++)
-            if (c_array[x] > max_v)
-                max_v = c_array[x];
     }
     return max_v;
 }
@@ -410,22 +491,19 @@ static void build_abs_diff_mask(const uint8_t *prvp, int prv_linesize,
 }
 
 /**
- * Build a map over which pixels differ a lot/a little
+ * Build a map over which pixels differ a lot/a little, for the field lines
+ * y = 2 + 2 * line with line in [line_start, line_end)
  */
 static void build_diff_map(FieldMatchContext *fm,
-                           const uint8_t *prvp, int prv_linesize,
-                           const uint8_t *nxtp, int nxt_linesize,
                            uint8_t *dstp, int dst_linesize, int height,
-                           int width, int plane)
+                           int width, int plane, int line_start, int line_end)
 {
     int x, y, u, diff, count;
     int tpitch = plane ? fm->tpitchuv : fm->tpitchy;
-    const uint8_t *dp = fm->tbuffer + tpitch;
-
-    build_abs_diff_mask(prvp, prv_linesize, nxtp, nxt_linesize,
-                        fm->tbuffer, tpitch, width, height>>1);
+    const uint8_t *dp = fm->tbuffer + tpitch * (1 + line_start);
 
-    for (y = 2; y < height - 2; y += 2) {
+    dstp += line_start * dst_linesize;
+    for (y = 2 + 2 * line_start; y < 2 + 2 * line_end; y += 2) {
         for (x = 1; x < width - 1; x++) {
             diff = dp[x];
             if (diff > 3) {
@@ -484,8 +562,113 @@ static AVFrame *select_frame(FieldMatchContext *fm, int match)
     else  /* match == mC */              return fm->src;
 }
 
-static int compare_fields(FieldMatchContext *fm, int match1, int match2, int field)
+static int diff_mask_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
+    FieldMatchContext *fm = ctx->priv;
+    const ThreadData *td = arg;
+    const int plane = td->plane;
+    const int tpitch = plane ? fm->tpitchuv : fm->tpitchy;
+    const int slice_start = (td->height *  jobnr   ) / nb_jobs;
+    const int slice_end   = (td->height * (jobnr+1)) / nb_jobs;
+    const int field_start = ((td->height >> 1) *  jobnr   ) / nb_jobs;
+    const int field_end   = ((td->height >> 1) * (jobnr+1)) / nb_jobs;
+
+    fill_buf(fm->map_data[plane] + slice_start * fm->map_linesize[plane],
+             td->width, slice_end - slice_start, fm->map_linesize[plane], 0);
+    build_abs_diff_mask(td->dprvp + field_start * td->dprv_linesize, td->dprv_linesize,
+                        td->dnxtp + field_start * td->dnxt_linesize, td->dnxt_linesize,
+                        fm->tbuffer + field_start * tpitch, tpitch,
+                        td->width, field_end - field_start);
+    return 0;
+}
+
+static int diff_map_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    FieldMatchContext *fm = ctx->priv;
+    const ThreadData *td = arg;
+    const int nb_lines = FFMAX((td->height - 3) / 2, 0);
+
+    build_diff_map(fm, td->dmapp, td->map_linesize, td->height, td->width, td->plane,
+                   (nb_lines *  jobnr   ) / nb_jobs,
+                   (nb_lines * (jobnr+1)) / nb_jobs);
+    return 0;
+}
+
+static int compare_fields_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    FieldMatchContext *fm = ctx->priv;
+    const ThreadData *td = arg;
+    uint64_t accumPc = 0, accumPm = 0, accumPml = 0;
+    uint64_t accumNc = 0, accumNm = 0, accumNml = 0;
+    const int nb_lines = FFMAX((td->height - 3) / 2, 0);
+    const int line_start = (nb_lines *  jobnr   ) / nb_jobs;
+    const int line_end   = (nb_lines * (jobnr+1)) / nb_jobs;
+    const int map_linesize  = td->map_linesize;
+    const int srcf_linesize = td->srcf_linesize;
+    const int prvf_linesize = td->prvf_linesize;
+    const int nxtf_linesize = td->nxtf_linesize;
+    const int startx = td->startx, stopx = td->stopx;
+    const int y0a = td->y0a, y1a = td->y1a;
+    const uint8_t *mapp  = td->mapp  + line_start * map_linesize;
+    const uint8_t *srcf  = td->srcf  + line_start * srcf_linesize;
+    const uint8_t *srcpf = srcf - srcf_linesize;
+    const uint8_t *srcnf = srcf + srcf_linesize;
+    const uint8_t *prvpf = td->prvpf + line_start * prvf_linesize;
+    const uint8_t *prvnf = prvpf + prvf_linesize;
+    const uint8_t *nxtpf = td->nxtpf + line_start * nxtf_linesize;
+    const uint8_t *nxtnf = nxtpf + nxtf_linesize;
+    int x, y, temp1, temp2;
+
+    for (y = 2 + 2 * line_start; y < 2 + 2 * line_end; y += 2) {
+        if (y0a == y1a || y < y0a || y > y1a) {
+            for (x = startx; x < stopx; x++) {
+                if (mapp[x] > 0 || mapp[x + map_linesize] > 0) {
+                    temp1 = srcpf[x] + (srcf[x] << 2) + srcnf[x]; // [1 4 1]
+
+                    temp2 = abs(3 * (prvpf[x] + prvnf[x]) - temp1);
+                    if (temp2 > 23 && ((mapp[x]&1) || (mapp[x + map_linesize]&1)))
+                        accumPc += temp2;
+                    if (temp2 > 42) {
+                        if ((mapp[x]&2) || (mapp[x + map_linesize]&2))
+                            accumPm += temp2;
+                        if ((mapp[x]&4) || (mapp[x + map_linesize]&4))
+                            accumPml += temp2;
+                    }
+
+                    temp2 = abs(3 * (nxtpf[x] + nxtnf[x]) - temp1);
+                    if (temp2 > 23 && ((mapp[x]&1) || (mapp[x + map_linesize]&1)))
+                        accumNc += temp2;
+                    if (temp2 > 42) {
+                        if ((mapp[x]&2) || (mapp[x + map_linesize]&2))
+                            accumNm += temp2;
+                        if ((mapp[x]&4) || (mapp[x + map_linesize]&4))
+                            accumNml += temp2;
+                    }
+                }
+            }
+        }
+        prvpf += prvf_linesize;
+        prvnf += prvf_linesize;
+        srcpf += srcf_linesize;
+        srcf  += srcf_linesize;
+        srcnf += srcf_linesize;
+        nxtpf += nxtf_linesize;
+        nxtnf += nxtf_linesize;
+        mapp  += map_linesize;
+    }
+
+    fm->job_sums[jobnr][0] = accumPc;
+    fm->job_sums[jobnr][1] = accumPm;
+    fm->job_sums[jobnr][2] = accumPml;
+    fm->job_sums[jobnr][3] = accumNc;
+    fm->job_sums[jobnr][4] = accumNm;
+    fm->job_sums[jobnr][5] = accumNml;
+    return 0;
+}
+
+static int compare_fields(AVFilterContext *ctx, int match1, int match2, int field)
+{
+    FieldMatchContext *fm = ctx->priv;
     int plane, ret;
     uint64_t accumPc = 0, accumPm = 0, accumPml = 0;
     uint64_t accumNc = 0, accumNm = 0, accumNml = 0;
@@ -494,7 +677,7 @@ static int compare_fields(FieldMatchContext *fm, int match1, int match2, int fie
     const AVFrame *src = fm->src;
 
     for (plane = 0; plane < (fm->mchroma ? 3 : 1); plane++) {
-        int x, y, temp1, temp2, fbase;
+        int i, fbase, nb_jobs;
         const AVFrame *prev, *next;
         uint8_t *mapp    = fm->map_data[plane];
         int map_linesize = fm->map_linesize[plane];
@@ -505,20 +688,22 @@ static int compare_fields(FieldMatchContext *fm, int match1, int match2, int fie
         int prvf_linesize, nxtf_linesize;
         const int width  = get_width (fm, src, plane, INPUT_MAIN);
         const int height = get_height(fm, src, plane, INPUT_MAIN);
-        const int y0a = fm->y0 >> (plane ? fm->vsub[INPUT_MAIN] : 0);
-        const int y1a = fm->y1 >> (plane ? fm->vsub[INPUT_MAIN] : 0);
         const int startx = (plane == 0 ? 8 : 8 >> fm->hsub[INPUT_MAIN]);
-        const int stopx  = width - startx;
-        const uint8_t *srcpf, *srcf, *srcnf;
+        const uint8_t *srcf;
         const uint8_t *prvpf, *prvnf, *nxtpf, *nxtnf;
-
-        fill_buf(mapp, width, height, map_linesize, 0);
+        ThreadData td = {
+            .plane  = plane,
+            .width  = width,
+            .height = height,
+            .y0a    = fm->y0 >> (plane ? fm->vsub[INPUT_MAIN] : 0),
+            .y1a    = fm->y1 >> (plane ? fm->vsub[INPUT_MAIN] : 0),
+            .startx = startx,
+            .stopx  = width - startx,
+        };
 
         /* match1 */
         fbase = get_field_base(match1, field);
         srcf  = srcp + (fbase + 1) * src_linesize;
-        srcpf = srcf - srcf_linesize;
-        srcnf = srcf + srcf_linesize;
         mapp  = mapp + fbase * map_linesize;
         prev = select_frame(fm, match1);
         prv_linesize  = prev->linesize[plane];
@@ -535,49 +720,40 @@ static int compare_fields(FieldMatchContext *fm, int match1, int match2, int fie
         nxtnf = nxtpf + nxtf_linesize;                      // next frame, next     field
 
         map_linesize <<= 1;
-        if ((match1 >= 3 && field == 1) || (match1 < 3 && field != 1))
-            build_diff_map(fm, prvpf, prvf_linesize, nxtpf, nxtf_linesize,
-                           mapp, map_linesize, height, width, plane);
-        else
-            build_diff_map(fm, prvnf, prvf_linesize, nxtnf, nxtf_linesize,
-                           mapp + map_linesize, map_linesize, height, width, plane);
-
-        for (y = 2; y < height - 2; y += 2) {
-            if (y0a == y1a || y < y0a || y > y1a) {
-                for (x = startx; x < stopx; x++) {
-                    if (mapp[x] > 0 || mapp[x + map_linesize] > 0) {
-                        temp1 = srcpf[x] + (srcf[x] << 2) + srcnf[x]; // [1 4 1]
-
-                        temp2 = abs(3 * (prvpf[x] + prvnf[x]) - temp1);
-                        if (temp2 > 23 && ((mapp[x]&1) || (mapp[x + map_linesize]&1)))
-                            accumPc += temp2;
-                        if (temp2 > 42) {
-                            if ((mapp[x]&2) || (mapp[x + map_linesize]&2))
-                                accumPm += temp2;
-                            if ((mapp[x]&4) || (mapp[x + map_linesize]&4))
-                                accumPml += temp2;
-                        }
+        td.dprv_linesize = prvf_linesize;
+        td.dnxt_linesize = nxtf_linesize;
+        if ((match1 >= 3 && field == 1) || (match1 < 3 && field != 1)) {
+            td.dprvp = prvpf;
+            td.dnxtp = nxtpf;
+            td.dmapp = mapp;
+        } else {
+            td.dprvp = prvnf;
+            td.dnxtp = nxtnf;
+            td.dmapp = mapp + map_linesize;
+        }
 
-                        temp2 = abs(3 * (nxtpf[x] + nxtnf[x]) - temp1);
-                        if (temp2 > 23 && ((mapp[x]&1) || (mapp[x + map_linesize]&1)))
-                            accumNc += temp2;
-                        if (temp2 > 42) {
-                            if ((mapp[x]&2) || (mapp[x + map_linesize]&2))
-                                accumNm += temp2;
-                            if ((mapp[x]&4) || (mapp[x + map_linesize]&4))
-                                accumNml += temp2;
-                        }
-                    }
-                }
-            }
-            prvpf += prvf_linesize;
-            prvnf += prvf_linesize;
-            srcpf += srcf_linesize;
-            srcf  += srcf_linesize;
-            srcnf += srcf_linesize;
-            nxtpf += nxtf_linesize;
-            nxtnf += nxtf_linesize;
-            mapp  += map_linesize;
+        td.mapp          = mapp;
+        td.map_linesize  = map_linesize;
+        td.srcf          = srcf;
+        td.srcf_linesize = srcf_linesize;
+        td.prvpf         = prvpf;
+        td.prvf_linesize = prvf_linesize;
+        td.nxtpf         = nxtpf;
+        td.nxtf_linesize = nxtf_linesize;
+
+        /* each stage reads lines the neighbouring jobs wrote in the previous one */
+        nb_jobs = FFMAX(1, FFMIN(fm->nb_threads, height >> 2));
+        ff_filter_execute(ctx, diff_mask_slice,      &td, NULL, nb_jobs);
+        ff_filter_execute(ctx, diff_map_slice,       &td, NULL, nb_jobs);
+        ff_filter_execute(ctx, compare_fields_slice, &td, NULL, nb_jobs);
+
+        for (i = 0; i < nb_jobs; i++) {
+            accumPc  += fm->job_sums[i][0];
+            accumPm  += fm->job_sums[i][1];
+            accumPml += fm->job_sums[i][2];
+            accumNc  += fm->job_sums[i][3];
+            accumNm  += fm->job_sums[i][4];
+            accumNml += fm->job_sums[i][5];
         }
     }
 
@@ -657,7 +833,7 @@ static int checkmm(AVFilterContext *ctx, int *combs, int m1, int m2,
             gen_frames[mid] = create_weave_frame(ctx, mid, field,               \
                                                  fm->prv, fm->src, fm->nxt,     \
                                                  INPUT_MAIN);                   \
-        combs[mid] = calc_combed_score(fm, gen_frames[mid]);                    \
+        combs[mid] = calc_combed_score(ctx, gen_frames[mid]);                   \
     }                                                                           \
 } while (0)
 
@@ -730,7 +906,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
                 ret = AVERROR(ENOMEM);
                 goto fail;
             }
-            combs[i] = calc_combed_score(fm, gen_frames[i]);
+            combs[i] = calc_combed_score(ctx, gen_frames[i]);
         }
         av_log(ctx, AV_LOG_INFO, "COMBS: %3d %3d %3d %3d %3d\n",
                combs[0], combs[1], combs[2], combs[3], combs[4]);
@@ -743,22 +919,22 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
     }
 
     /* p/c selection and optional 3-way p/c/n matches */
-    match = compare_fields(fm, fxo[mC], fxo[mP], field);
+    match = compare_fields(ctx, fxo[mC], fxo[mP], field);
     if (fm->mode == MODE_PCN || fm->mode == MODE_PCN_UB)
-        match = compare_fields(fm, match, fxo[mN], field);
+        match = compare_fields(ctx, match, fxo[mN], field);
 
     /* scene change check */
     if (fm->combmatch == COMBMATCH_SC) {
         if (fm->lastn == outlink->frame_count_in - 1) {
             if (fm->lastscdiff > fm->scthresh)
                 sc = 1;
-        } else if (luma_abs_diff(fm->prv, fm->src) > fm->scthresh) {
+        } else if (luma_abs_diff(ctx, fm->prv, fm->src) > fm->scthresh) {
             sc = 1;
         }
 
         if (!sc) {
             fm->lastn = outlink->frame_count_in;
-            fm->lastscdiff = luma_abs_diff(fm->src, fm->nxt);
+            fm->lastscdiff = luma_abs_diff(ctx, fm->src, fm->nxt);
             sc = fm->lastscdiff > fm->scthresh;
         }
     }
@@ -956,11 +1132,15 @@ static int config_input(AVFilterLink *inlink)
     fm->tpitchy  = FFALIGN(w,      16);
     fm->tpitchuv = FFALIGN(w >> 1, 16);
 
+    fm->nb_threads = ff_filter_get_nb_threads(ctx);
+    fm->c_array_size = (((w + fm->blockx/2)/fm->blockx)+1) *
+                       (((h + fm->blocky/2)/fm->blocky)+1) * 4;
+
     fm->tbuffer = av_calloc((h/2 + 4) * fm->tpitchy, sizeof(*fm->tbuffer));
-    fm->c_array = av_malloc_array((((w + fm->blockx/2)/fm->blockx)+1) *
-                            (((h + fm->blocky/2)/fm->blocky)+1),
-                            4 * sizeof(*fm->c_array));
-    if (!fm->tbuffer || !fm->c_array)
+    fm->c_array = av_malloc_array(fm->nb_threads,
+                                  fm->c_array_size * sizeof(*fm->c_array));
+    fm->job_sums = av_calloc(fm->nb_threads, sizeof(*fm->job_sums));
+    if (!fm->tbuffer || !fm->c_array || !fm->job_sums)
         return AVERROR(ENOMEM);
 
     return 0;
@@ -1018,6 +1198,7 @@ static av_cold void fieldmatch_uninit(AVFilterContext *ctx)
     av_freep(&fm->cmask_data[0]);
     av_freep(&fm->tbuffer);
     av_freep(&fm->c_array);
+    av_freep(&fm->job_sums);
 }
 
 static int config_output(AVFilterLink *outlink)
@@ -1056,5 +1237,5 @@ const AVFilter ff_vf_fieldmatch = {
     FILTER_OUTPUTS(fieldmatch_outputs),
     FILTER_QUERY_FUNC(query_formats),
     .priv_class     = &fieldmatch_class,
-    .flags          = AVFILTER_FLAG_DYNAMIC_INPUTS,
+    .flags          = AVFILTER_FLAG_DYNAMIC_INPUTS | AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -28,6 +28,7 @@
 
 #include "avfilter.h"
 #include "filters.h"
+#include "internal.h"
 #include "scene_sad.h"
 
 typedef struct FreezeDetectContext {
@@ -37,6 +38,8 @@ typedef struct FreezeDetectContext {
     ptrdiff_t height[4];
     ff_scene_sad_fn sad;
     int bitdepth;
+    int nb_threads;
+    uint64_t *sad_sums;          ///< per job SAD, summed in job order
     AVFrame *reference_frame;
     int64_t n;
     int64_t reference_n;
@@ -106,6 +109,12 @@ static int config_input(AVFilterLink *inlink)
     if (!s->sad)
         return AVERROR(EINVAL);
 
+    s->nb_threads = FFMIN(ff_filter_get_nb_threads(ctx), inlink->h);
+    av_freep(&s->sad_sums);
+    s->sad_sums = av_calloc(s->nb_threads, sizeof(*s->sad_sums));
+    if (!s->sad_sums)
+        return AVERROR(ENOMEM);
+
     return 0;
 }
 
@@ -113,24 +122,57 @@ static av_cold void uninit(AVFilterContext *ctx)
 {
     FreezeDetectContext *s = ctx->priv;
     av_frame_free(&s->reference_frame);
+    av_freep(&s->sad_sums);
 }
 
-static int is_frozen(FreezeDetectContext *s, AVFrame *reference, AVFrame *frame)
+typedef struct ThreadData {
+    AVFrame *reference, *frame;
+} ThreadData;
+
+static int sad_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
+    FreezeDetectContext *s = ctx->priv;
+    ThreadData *td = arg;
     uint64_t sad = 0;
-    uint64_t count = 0;
-    double mafd;
+
     for (int plane = 0; plane < 4; plane++) {
         if (s->width[plane]) {
+            const int start = (s->height[plane] *  jobnr     ) / nb_jobs;
+            const int end   = (s->height[plane] * (jobnr + 1)) / nb_jobs;
+            const ptrdiff_t linesize1 = td->frame->linesize[plane];
+            const ptrdiff_t linesize2 = td->reference->linesize[plane];
             uint64_t plane_sad;
-            s->sad(frame->data[plane], frame->linesize[plane],
-                   reference->data[plane], reference->linesize[plane],
-                   s->width[plane], s->height[plane], &plane_sad);
+
+            /* the asm versions always process at least one row */
+            if (end <= start)
+                continue;
+
+            s->sad(td->frame->data[plane] + start * linesize1, linesize1,
+                   td->reference->data[plane] + start * linesize2, linesize2,
+                   s->width[plane], end - start, &plane_sad);
             sad += plane_sad;
-            count += s->width[plane] * s->height[plane];
         }
     }
     emms_c();
+    s->sad_sums[jobnr] = sad;
+
+    return 0;
+}
+
+static int is_frozen(AVFilterContext *ctx, AVFrame *reference, AVFrame *frame)
+{
+    FreezeDetectContext *s = ctx->priv;
+    ThreadData td = { .reference = reference, .frame = frame };
+    uint64_t sad = 0;
+    uint64_t count = 0;
+    double mafd;
+
+    ff_filter_execute(ctx, sad_slice, &td, NULL, s->nb_threads);
+
+    for (int i = 0; i < s->nb_threads; i++)
+        sad += s->sad_sums[i];
+    for (int plane = 0; plane < 4; plane++)
+        count += s->width[plane] * s->height[plane];
     mafd = (double)sad / count / (1ULL << s->bitdepth);
     return (mafd <= s->noise);
 }
@@ -166,7 +208,7 @@ static int activate(AVFilterContext *ctx)
             else
                 duration = av_rescale_q(frame->pts - s->reference_frame->pts, inlink->time_base, AV_TIME_BASE_Q);
 
-            frozen = is_frozen(s, s->reference_frame, frame);
+            frozen = is_frozen(ctx, s->reference_frame, frame);
             if (duration >= s->duration) {
                 if (!s->frozen)
                     set_meta(s, frame, "lavfi.freezedetect.freeze_start", av_ts2timestr(s->reference_frame->pts, &inlink->time_base));
@@ -217,7 +259,7 @@ const AVFilter ff_vf_freezedetect = {
     .priv_size     = sizeof(FreezeDetectContext),
     .priv_class    = &freezedetect_class,
     .uninit        = uninit,
-    .flags         = AVFILTER_FLAG_METADATA_ONLY,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS | AVFILTER_FLAG_METADATA_ONLY,
     FILTER_INPUTS(freezedetect_inputs),
     FILTER_OUTPUTS(freezedetect_outputs),
     FILTER_PIXFMTS_ARRAY(pix_fmts),
@@ -61,8 +61,16 @@ typedef struct HistogramContext {
     int            planeheight[4];
     int            start[4];
     AVFrame       *out;
+    int            nb_threads;
+    int            jobs_histogram_size;
+    unsigned      *jobs_histogram;      ///< per job partial histograms
 } HistogramContext;
 
+typedef struct ThreadData {
+    AVFrame *in;
+    int plane;
+} ThreadData;
+
 #define OFFSET(x) offsetof(HistogramContext, x)
 #define FLAGS AV_OPT_FLAG_FILTERING_PARAM|AV_OPT_FLAG_VIDEO_PARAM
 
@@ -229,7 +237,8 @@ static const uint8_t blue_gbrp_color[4]  = {   0,   0, 255, 255 };
 
 static int config_input(AVFilterLink *inlink)
 {
-    HistogramContext *s = inlink->dst->priv;
+    AVFilterContext *ctx = inlink->dst;
+    HistogramContext *s = ctx->priv;
     int rgb = 0;
 
     s->desc  = av_pix_fmt_desc_get(inlink->format);
@@ -365,6 +374,43 @@ static int config_input(AVFilterLink *inlink)
     s->planewidth[1]  = s->planewidth[2]  = AV_CEIL_RSHIFT(inlink->w, s->desc->log2_chroma_w);
     s->planewidth[0]  = s->planewidth[3]  = inlink->w;
 
+    s->nb_threads = ff_filter_get_nb_threads(ctx);
+    /* out of range high bit depth samples must not write past the buffers */
+    s->jobs_histogram_size = s->histogram_size <= 256 ? 256 : 256 * 256;
+    av_freep(&s->jobs_histogram);
+    s->jobs_histogram = av_calloc(s->nb_threads, s->jobs_histogram_size * sizeof(*s->jobs_histogram));
+    if (!s->jobs_histogram)
+        return AVERROR(ENOMEM);
+
+    return 0;
+}
+
+static int compute_histogram(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    HistogramContext *s = ctx->priv;
+    ThreadData *td = arg;
+    AVFrame *in = td->in;
+    const int p = td->plane;
+    const int height = s->planeheight[p];
+    const int width = s->planewidth[p];
+    const int slice_start = (height * jobnr) / nb_jobs;
+    const int slice_end = (height * (jobnr+1)) / nb_jobs;
+    unsigned *histogram = s->jobs_histogram + jobnr * s->jobs_histogram_size;
+
+    if (s->histogram_size <= 256) {
+        for (int i = slice_start; i < slice_end; i++) {
+            const uint8_t *src = in->data[p] + i * in->linesize[p];
+            for (int j = 0; j < width; j++)
+                histogram[src[j]]++;
+        }
+    } else {
+        for (int i = slice_start; i < slice_end; i++) {
+            const uint16_t *src = (const uint16_t *)(in->data[p] + i * in->linesize[p]);
+            for (int j = 0; j < width; j++)
+                histogram[src[j]]++;
+        }
+    }
+
     return 0;
 }
 
@@ -405,7 +451,8 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
     AVFilterContext *ctx  = inlink->dst;
     AVFilterLink *outlink = ctx->outputs[0];
     AVFrame *out = s->out;
-    int i, j, k, l, m;
+    ThreadData td;
+    int i, j, k, l, m, nb_jobs;
 
     if (!s->thistogram || !out) {
         out = ff_get_video_buffer(outlink, outlink->w, outlink->h);
@@ -440,8 +487,6 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
     for (m = 0, k = 0; k < s->ncomp; k++) {
         const int p = s->desc->comp[k].plane;
         const int max_value = s->histogram_size - 1 - s->start[p];
-        const int height = s->planeheight[p];
-        const int width = s->planewidth[p];
         const int mid = s->mid;
         double max_hval_log;
         unsigned max_hval = 0;
@@ -457,18 +502,17 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
             starty = m++ * (s->level_height + s->scale_height) * (s->display_mode == 2);
         }
 
-        if (s->histogram_size <= 256) {
-            for (i = 0; i < height; i++) {
-                const uint8_t *src = in->data[p] + i * in->linesize[p];
-                for (j = 0; j < width; j++)
-                    s->histogram[src[j]]++;
-            }
-        } else {
-            for (i = 0; i < height; i++) {
-                const uint16_t *src = (const uint16_t *)(in->data[p] + i * in->linesize[p]);
-                for (j = 0; j < width; j++)
-                    s->histogram[src[j]]++;
-            }
+        td.in = in;
+        td.plane = p;
+        nb_jobs = FFMAX(1, FFMIN(s->nb_threads, s->planeheight[p]));
+        ff_filter_execute(ctx, compute_histogram, &td, NULL, nb_jobs);
+
+        for (l = 0; l < nb_jobs; l++) {
+            unsigned *histogram = s->jobs_histogram + l * s->jobs_histogram_size;
+
+            for (i = 0; i < s->histogram_size; i++)
+                s->histogram[i] += histogram[i];
+            memset(histogram, 0, s->histogram_size * sizeof(*histogram));
         }
 
         for (i = 0; i < s->histogram_size; i++)
@@ -617,6 +661,16 @@ end:
     return ff_filter_frame(outlink, out);
 }
 
+static av_cold void uninit(AVFilterContext *ctx)
+{
+    HistogramContext *s = ctx->priv;
+
+    /* histogram passes its frames on, thistogram keeps drawing into one */
+    if (s->thistogram)
+        av_frame_free(&s->out);
+    av_freep(&s->jobs_histogram);
+}
+
 static const AVFilterPad inputs[] = {
     {
         .name         = "default",
@@ -643,20 +697,15 @@ const AVFilter ff_vf_histogram = {
     FILTER_INPUTS(inputs),
     FILTER_OUTPUTS(outputs),
     FILTER_QUERY_FUNC(query_formats),
+    .uninit        = uninit,
     .priv_class    = &histogram_class,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 };
 
 #endif /* CONFIG_HISTOGRAM_FILTER */
 
 #if CONFIG_THISTOGRAM_FILTER
 
-static av_cold void uninit(AVFilterContext *ctx)
-{
-    HistogramContext *s = ctx->priv;
-
-    av_frame_free(&s->out);
-}
-
 static const AVOption thistogram_options[] = {
     { "width", "set width", OFFSET(width), AV_OPT_TYPE_INT, {.i64=0}, 0, 8192, FLAGS},
     { "w",     "set width", OFFSET(width), AV_OPT_TYPE_INT, {.i64=0}, 0, 8192, FLAGS},
@@ -687,6 +736,7 @@ const AVFilter ff_vf_thistogram = {
     FILTER_QUERY_FUNC(query_formats),
     .uninit        = uninit,
     .priv_class    = &thistogram_class,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 };
 
 #endif /* CONFIG_THISTOGRAM_FILTER */
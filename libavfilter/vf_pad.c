@@ -100,6 +100,9 @@ typedef struct PadContext {
     FFDrawColor color;
 
     int eval_mode;          ///< expression evaluation mode
+
+    uint64_t nb_direct;     ///< number of frames padded in place
+    uint64_t nb_copied;     ///< number of frames copied into a new buffer
 } PadContext;
 
 static int config_input(AVFilterLink *inlink)
@@ -320,10 +323,62 @@ static int frame_needs_copy(PadContext *s, AVFrame *frame)
     return 0;
 }
 
+typedef struct ThreadData {
+    AVFrame *in, *out;
+    int needs_copy;
+} ThreadData;
+
+static void fill_rows(PadContext *s, AVFrame *out, int x, int y0, int y1, int w,
+                      int slice_start, int slice_end)
+{
+    y0 = FFMAX(y0, slice_start);
+    y1 = FFMIN(y1, slice_end);
+    if (w > 0 && y1 > y0)
+        ff_fill_rectangle(&s->draw, &s->color, out->data, out->linesize,
+                          x, y0, w, y1 - y0);
+}
+
+/* fill the borders and copy the input area of a band of output rows */
+static int pad_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    PadContext *s = ctx->priv;
+    ThreadData *td = arg;
+    AVFrame *in = td->in, *out = td->out;
+    const int vsub_mask = (1 << s->draw.vsub_max) - 1;
+    const int slice_start = (s->h *  jobnr     / nb_jobs) & ~vsub_mask;
+    const int slice_end   = jobnr == nb_jobs - 1 ? s->h :
+                            (s->h * (jobnr + 1) / nb_jobs) & ~vsub_mask;
+    const int in_start    = FFMAX(s->y, slice_start);
+    const int in_end      = FFMIN(s->y + in->height, slice_end);
+
+    /* top bar */
+    fill_rows(s, out, 0, 0, s->y, s->w, slice_start, slice_end);
+
+    /* bottom bar */
+    fill_rows(s, out, 0, s->y + s->in_h, s->h, s->w, slice_start, slice_end);
+
+    /* left border */
+    fill_rows(s, out, 0, s->y, s->y + in->height, s->x, slice_start, slice_end);
+
+    if (td->needs_copy && in_end > in_start) {
+        ff_copy_rectangle2(&s->draw,
+                          out->data, out->linesize, in->data, in->linesize,
+                          s->x, in_start, 0, in_start - s->y, in->width, in_end - in_start);
+    }
+
+    /* right border */
+    fill_rows(s, out, s->x + s->in_w, s->y, s->y + in->height, s->w - s->x - s->in_w,
+              slice_start, slice_end);
+
+    return 0;
+}
+
 static int filter_frame(AVFilterLink *inlink, AVFrame *in)
 {
-    PadContext *s = inlink->dst->priv;
-    AVFilterLink *outlink = inlink->dst->outputs[0];
+    AVFilterContext *ctx = inlink->dst;
+    PadContext *s = ctx->priv;
+    AVFilterLink *outlink = ctx->outputs[0];
+    ThreadData td;
     AVFrame *out;
     int needs_copy;
     if(s->eval_mode == EVAL_MODE_FRAME && (
@@ -355,6 +410,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
 
     if (needs_copy) {
         av_log(inlink->dst, AV_LOG_DEBUG, "Direct padding impossible allocating new frame\n");
+        s->nb_copied++;
         out = ff_get_video_buffer(outlink,
                                   FFMAX(inlink->w, s->w),
                                   FFMAX(inlink->h, s->h));
@@ -367,6 +423,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
     } else {
         int i;
 
+        s->nb_direct++;
         out = in;
         for (i = 0; i < 4 && out->data[i] && out->linesize[i]; i++) {
             int hsub = s->draw.hsub[i];
@@ -376,34 +433,11 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
         }
     }
 
-    /* top bar */
-    if (s->y) {
-        ff_fill_rectangle(&s->draw, &s->color,
-                          out->data, out->linesize,
-                          0, 0, s->w, s->y);
-    }
-
-    /* bottom bar */
-    if (s->h > s->y + s->in_h) {
-        ff_fill_rectangle(&s->draw, &s->color,
-                          out->data, out->linesize,
-                          0, s->y + s->in_h, s->w, s->h - s->y - s->in_h);
-    }
-
-    /* left border */
-    ff_fill_rectangle(&s->draw, &s->color, out->data, out->linesize,
-                      0, s->y, s->x, in->height);
-
-    if (needs_copy) {
-        ff_copy_rectangle2(&s->draw,
-                          out->data, out->linesize, in->data, in->linesize,
-                          s->x, s->y, 0, 0, in->width, in->height);
-    }
-
-    /* right border */
-    ff_fill_rectangle(&s->draw, &s->color, out->data, out->linesize,
-                      s->x + s->in_w, s->y, s->w - s->x - s->in_w,
-                      in->height);
+    td.in = in;
+    td.out = out;
+    td.needs_copy = needs_copy;
+    ff_filter_execute(ctx, pad_slice, &td, NULL,
+                      FFMIN(s->h >> s->draw.vsub_max, ff_filter_get_nb_threads(ctx)));
 
     out->width  = s->w;
     out->height = s->h;
@@ -413,6 +447,15 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
     return ff_filter_frame(outlink, out);
 }
 
+static av_cold void uninit(AVFilterContext *ctx)
+{
+    PadContext *s = ctx->priv;
+
+    if (s->nb_direct || s->nb_copied)
+        av_log(ctx, AV_LOG_VERBOSE, "%"PRIu64" frames padded in place, %"PRIu64" frames copied\n",
+               s->nb_direct, s->nb_copied);
+}
+
 #define OFFSET(x) offsetof(PadContext, x)
 #define FLAGS AV_OPT_FLAG_FILTERING_PARAM|AV_OPT_FLAG_VIDEO_PARAM
 
@@ -456,7 +499,9 @@ const AVFilter ff_vf_pad = {
     .description   = NULL_IF_CONFIG_SMALL("Pad the input video."),
     .priv_size     = sizeof(PadContext),
     .priv_class    = &pad_class,
+    .uninit        = uninit,
     FILTER_INPUTS(avfilter_vf_pad_inputs),
     FILTER_OUTPUTS(avfilter_vf_pad_outputs),
     FILTER_QUERY_FUNC(query_formats),
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 };
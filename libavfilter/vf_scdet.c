@@ -28,6 +28,7 @@
 
 #include "avfilter.h"
 #include "filters.h"
+#include "internal.h"
 #include "scene_sad.h"
 
 typedef struct SCDetContext {
@@ -38,6 +39,8 @@ typedef struct SCDetContext {
     int nb_planes;
     int bitdepth;
     ff_scene_sad_fn sad;
+    int nb_threads;
+    uint64_t *sad_sums;          ///< per job SAD, summed in job order
     double prev_mafd;
     double scene_score;
     AVFrame *prev_picref;
@@ -94,6 +97,12 @@ static int config_input(AVFilterLink *inlink)
     if (!s->sad)
         return AVERROR(EINVAL);
 
+    s->nb_threads = FFMIN(ff_filter_get_nb_threads(ctx), inlink->h);
+    av_freep(&s->sad_sums);
+    s->sad_sums = av_calloc(s->nb_threads, sizeof(*s->sad_sums));
+    if (!s->sad_sums)
+        return AVERROR(ENOMEM);
+
     return 0;
 }
 
@@ -102,6 +111,39 @@ static av_cold void uninit(AVFilterContext *ctx)
     SCDetContext *s = ctx->priv;
 
     av_frame_free(&s->prev_picref);
+    av_freep(&s->sad_sums);
+}
+
+typedef struct ThreadData {
+    AVFrame *prev, *cur;
+} ThreadData;
+
+static int sad_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    SCDetContext *s = ctx->priv;
+    ThreadData *td = arg;
+    uint64_t sad = 0;
+
+    for (int plane = 0; plane < s->nb_planes; plane++) {
+        const int start = (s->height[plane] *  jobnr     ) / nb_jobs;
+        const int end   = (s->height[plane] * (jobnr + 1)) / nb_jobs;
+        const ptrdiff_t linesize1 = td->prev->linesize[plane];
+        const ptrdiff_t linesize2 = td->cur->linesize[plane];
+        uint64_t plane_sad;
+
+        /* the asm versions always process at least one row */
+        if (end <= start)
+            continue;
+
+        s->sad(td->prev->data[plane] + start * linesize1, linesize1,
+               td->cur->data[plane] + start * linesize2, linesize2,
+               s->width[plane], end - start, &plane_sad);
+        sad += plane_sad;
+    }
+    emms_c();
+    s->sad_sums[jobnr] = sad;
+
+    return 0;
 }
 
 static double get_scene_score(AVFilterContext *ctx, AVFrame *frame)
@@ -112,20 +154,18 @@ static double get_scene_score(AVFilterContext *ctx, AVFrame *frame)
 
     if (prev_picref && frame->height == prev_picref->height
                     && frame->width  == prev_picref->width) {
+        ThreadData td = { .prev = prev_picref, .cur = frame };
         uint64_t sad = 0;
         double mafd, diff;
         uint64_t count = 0;
 
-        for (int plane = 0; plane < s->nb_planes; plane++) {
-            uint64_t plane_sad;
-            s->sad(prev_picref->data[plane], prev_picref->linesize[plane],
-                    frame->data[plane], frame->linesize[plane],
-                    s->width[plane], s->height[plane], &plane_sad);
-            sad += plane_sad;
+        ff_filter_execute(ctx, sad_slice, &td, NULL, s->nb_threads);
+
+        for (int i = 0; i < s->nb_threads; i++)
+            sad += s->sad_sums[i];
+        for (int plane = 0; plane < s->nb_planes; plane++)
             count += s->width[plane] * s->height[plane];
-        }
 
-        emms_c();
         mafd = (double)sad * 100. / count / (1ULL << s->bitdepth);
         diff = fabs(mafd - s->prev_mafd);
         ret  = av_clipf(FFMIN(mafd, diff), 0, 100.);
@@ -206,7 +246,7 @@ const AVFilter ff_vf_scdet = {
     .priv_size     = sizeof(SCDetContext),
     .priv_class    = &scdet_class,
     .uninit        = uninit,
-    .flags         = AVFILTER_FLAG_METADATA_ONLY,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS | AVFILTER_FLAG_METADATA_ONLY,
     FILTER_INPUTS(scdet_inputs),
     FILTER_OUTPUTS(scdet_outputs),
     FILTER_PIXFMTS_ARRAY(pix_fmts),
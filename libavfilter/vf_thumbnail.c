@@ -46,6 +46,11 @@ typedef struct ThumbContext {
     struct thumb_frame *frames; ///< the n_frames frames
     AVRational tb;              ///< copy of the input timebase to ease access
 
+    int64_t sum_hist[HIST_SIZE];    ///< sum of the histograms of the current batch
+
+    int nb_threads;
+    int *thread_histogram;      ///< per job histograms
+
     int planewidth[4];
     int planeheight[4];
 } ThumbContext;
@@ -96,16 +101,13 @@ static AVFrame *get_best_frame(AVFilterContext *ctx)
 {
     AVFrame *picref;
     ThumbContext *s = ctx->priv;
-    int i, j, best_frame_idx = 0;
+    int i, best_frame_idx = 0;
     int nb_frames = s->n;
-    double avg_hist[HIST_SIZE] = {0}, sq_err, min_sq_err = -1;
+    double avg_hist[HIST_SIZE], sq_err, min_sq_err = -1;
 
     // average histogram of the N frames
-    for (j = 0; j < FF_ARRAY_ELEMS(avg_hist); j++) {
-        for (i = 0; i < nb_frames; i++)
-            avg_hist[j] += (double)s->frames[i].histogram[j];
-        avg_hist[j] /= nb_frames;
-    }
+    for (i = 0; i < FF_ARRAY_ELEMS(avg_hist); i++)
+        avg_hist[i] = (double)s->sum_hist[i] / nb_frames;
 
     // find the frame closer to the average using the sum of squared errors
     for (i = 0; i < nb_frames; i++) {
@@ -115,11 +117,10 @@ static AVFrame *get_best_frame(AVFilterContext *ctx)
     }
 
     // free and reset everything (except the best frame buffer)
-    for (i = 0; i < nb_frames; i++) {
-        memset(s->frames[i].histogram, 0, sizeof(s->frames[i].histogram));
+    for (i = 0; i < nb_frames; i++)
         if (i != best_frame_idx)
             av_frame_free(&s->frames[i].buf);
-    }
+    memset(s->sum_hist, 0, sizeof(s->sum_hist));
     s->n = 0;
 
     // raise the chosen one
@@ -132,24 +133,25 @@ static AVFrame *get_best_frame(AVFilterContext *ctx)
     return picref;
 }
 
-static int filter_frame(AVFilterLink *inlink, AVFrame *frame)
+static int do_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
+    ThumbContext *s = ctx->priv;
+    AVFrame *frame = arg;
+    int *hist = s->thread_histogram + HIST_SIZE * jobnr;
+    const int h = frame->height;
+    const int w = frame->width;
+    const int slice_start = (h * jobnr) / nb_jobs;
+    const int slice_end = (h * (jobnr+1)) / nb_jobs;
+    const uint8_t *p = frame->data[0] + slice_start * frame->linesize[0];
     int i, j;
-    AVFilterContext *ctx  = inlink->dst;
-    ThumbContext *s   = ctx->priv;
-    AVFilterLink *outlink = ctx->outputs[0];
-    int *hist = s->frames[s->n].histogram;
-    const uint8_t *p = frame->data[0];
 
-    // keep a reference of each frame
-    s->frames[s->n].buf = frame;
+    memset(hist, 0, sizeof(*hist) * HIST_SIZE);
 
-    // update current frame histogram
-    switch (inlink->format) {
+    switch (frame->format) {
     case AV_PIX_FMT_RGB24:
     case AV_PIX_FMT_BGR24:
-        for (j = 0; j < inlink->h; j++) {
-            for (i = 0; i < inlink->w; i++) {
+        for (j = slice_start; j < slice_end; j++) {
+            for (i = 0; i < w; i++) {
                 hist[0*256 + p[i*3    ]]++;
                 hist[1*256 + p[i*3 + 1]]++;
                 hist[2*256 + p[i*3 + 2]]++;
@@ -161,8 +163,8 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *frame)
     case AV_PIX_FMT_BGR0:
     case AV_PIX_FMT_RGBA:
     case AV_PIX_FMT_BGRA:
-        for (j = 0; j < inlink->h; j++) {
-            for (i = 0; i < inlink->w; i++) {
+        for (j = slice_start; j < slice_end; j++) {
+            for (i = 0; i < w; i++) {
                 hist[0*256 + p[i*4    ]]++;
                 hist[1*256 + p[i*4 + 1]]++;
                 hist[2*256 + p[i*4 + 2]]++;
@@ -174,8 +176,8 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *frame)
     case AV_PIX_FMT_0BGR:
     case AV_PIX_FMT_ARGB:
     case AV_PIX_FMT_ABGR:
-        for (j = 0; j < inlink->h; j++) {
-            for (i = 0; i < inlink->w; i++) {
+        for (j = slice_start; j < slice_end; j++) {
+            for (i = 0; i < w; i++) {
                 hist[0*256 + p[i*4 + 1]]++;
                 hist[1*256 + p[i*4 + 2]]++;
                 hist[2*256 + p[i*4 + 3]]++;
@@ -185,8 +187,10 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *frame)
         break;
     default:
         for (int plane = 0; plane < 3; plane++) {
-            const uint8_t *p = frame->data[plane];
-            for (j = 0; j < s->planeheight[plane]; j++) {
+            const int plane_start = (s->planeheight[plane] * jobnr) / nb_jobs;
+            const int plane_end = (s->planeheight[plane] * (jobnr+1)) / nb_jobs;
+            const uint8_t *p = frame->data[plane] + plane_start * frame->linesize[plane];
+            for (j = plane_start; j < plane_end; j++) {
                 for (i = 0; i < s->planewidth[plane]; i++)
                     hist[256*plane + p[i]]++;
                 p += frame->linesize[plane];
@@ -195,6 +199,31 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *frame)
         break;
     }
 
+    return 0;
+}
+
+static int filter_frame(AVFilterLink *inlink, AVFrame *frame)
+{
+    int i, j;
+    AVFilterContext *ctx  = inlink->dst;
+    ThumbContext *s   = ctx->priv;
+    AVFilterLink *outlink = ctx->outputs[0];
+    int *hist = s->frames[s->n].histogram;
+    const int nb_jobs = FFMIN(inlink->h, s->nb_threads);
+
+    // keep a reference of each frame
+    s->frames[s->n].buf = frame;
+
+    // update current frame histogram
+    ff_filter_execute(ctx, do_slice, frame, NULL, nb_jobs);
+
+    for (i = 0; i < HIST_SIZE; i++) {
+        hist[i] = 0;
+        for (j = 0; j < nb_jobs; j++)
+            hist[i] += s->thread_histogram[j * HIST_SIZE + i];
+        s->sum_hist[i] += hist[i];
+    }
+
     // no selection until the buffer of N frames is filled up
     s->n++;
     if (s->n < s->n_frames)
@@ -210,6 +239,7 @@ static av_cold void uninit(AVFilterContext *ctx)
     for (i = 0; i < s->n_frames && s->frames && s->frames[i].buf; i++)
         av_frame_free(&s->frames[i].buf);
     av_freep(&s->frames);
+    av_freep(&s->thread_histogram);
 }
 
 static int request_frame(AVFilterLink *link)
@@ -241,6 +271,12 @@ static int config_props(AVFilterLink *inlink)
     s->planeheight[1] = s->planeheight[2] = AV_CEIL_RSHIFT(inlink->h, desc->log2_chroma_h);
     s->planeheight[0] = s->planeheight[3] = inlink->h;
 
+    s->nb_threads = ff_filter_get_nb_threads(ctx);
+    av_freep(&s->thread_histogram);
+    s->thread_histogram = av_calloc(s->nb_threads, HIST_SIZE * sizeof(*s->thread_histogram));
+    if (!s->thread_histogram)
+        return AVERROR(ENOMEM);
+
     return 0;
 }
 
@@ -288,5 +324,5 @@ const AVFilter ff_vf_thumbnail = {
     FILTER_OUTPUTS(thumbnail_outputs),
     FILTER_PIXFMTS_ARRAY(pix_fmts),
     .priv_class    = &thumbnail_class,
-    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC,
+    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC | AVFILTER_FLAG_SLICE_THREADS,
 };
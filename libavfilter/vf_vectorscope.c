@@ -77,7 +77,10 @@ typedef struct VectorscopeContext {
     uint8_t *peak_memory;
     uint8_t **peak;
 
-    void (*vectorscope)(struct VectorscopeContext *s,
+    int nb_jobs;
+    uint16_t *acc;              ///< per job size x size accumulation buffers, or NULL
+
+    void (*vectorscope)(AVFilterContext *ctx,
                         AVFrame *in, AVFrame *out, int pd);
     void (*graticulef)(struct VectorscopeContext *s, AVFrame *out,
                        int X, int Y, int D, int P);
@@ -270,8 +273,10 @@ static int query_formats(AVFilterContext *ctx)
 
 static int config_output(AVFilterLink *outlink)
 {
-    VectorscopeContext *s = outlink->src->priv;
-    int i;
+    AVFilterContext *ctx = outlink->src;
+    AVFilterLink *inlink = ctx->inputs[0];
+    VectorscopeContext *s = ctx->priv;
+    int i, nb_threads;
 
     outlink->h = outlink->w = s->size;
     outlink->sample_aspect_ratio = (AVRational){1,1};
@@ -287,6 +292,21 @@ static int config_output(AVFilterLink *outlink)
     for (i = 0; i < s->size; i++)
         s->peak[i] = s->peak_memory + s->size * i;
 
+    /* Merging the accumulation buffers costs nb_jobs * size^2 per frame,
+     * only use them while that stays below the number of input samples.
+     * Otherwise the jobs plot directly into bands of output rows. */
+    nb_threads = ff_filter_get_nb_threads(ctx);
+    s->nb_jobs = FFMIN3(nb_threads, inlink->h,
+                        (int64_t)inlink->w * inlink->h / ((int64_t)s->size * s->size));
+    av_freep(&s->acc);
+    if (s->nb_jobs > 1) {
+        s->acc = av_calloc((size_t)s->nb_jobs * s->size, s->size * sizeof(*s->acc));
+        if (!s->acc)
+            return AVERROR(ENOMEM);
+    } else {
+        s->nb_jobs = FFMIN(nb_threads, s->size);
+    }
+
     return 0;
 }
 
@@ -414,22 +434,232 @@ static void envelope(VectorscopeContext *s, AVFrame *out)
     }
 }
 
-static void vectorscope16(VectorscopeContext *s, AVFrame *in, AVFrame *out, int pd)
+/*
+ * The points of each job are accumulated in its own buffer and merged
+ * into the output afterwards. An entry is 0 if no sample hit the point,
+ * otherwise 1 plus the saturated sum of intensities, or 1 plus the
+ * largest sample for color4. These merge in any order to the same result
+ * as accumulating all samples in the output directly.
+ */
+static av_always_inline void accumulate(VectorscopeContext *s, AVFrame *in,
+                                        int jobnr, int nb_jobs, int mode, int is16)
 {
-    const uint16_t * const *src = (const uint16_t * const *)in->data;
-    const int slinesizex = in->linesize[s->x] / 2;
-    const int slinesizey = in->linesize[s->y] / 2;
-    const int slinesized = in->linesize[pd] / 2;
-    const int dlinesize = out->linesize[0] / 2;
+    const int px = s->x, py = s->y, pd = s->pd;
+    const int max = s->size - 1;
     const int intensity = s->intensity;
+    const int tmin = s->tmin;
+    const int tmax = s->tmax;
+    const int hsub = mode == COLOR4 ? s->hsub : 0;
+    const int vsub = mode == COLOR4 ? s->vsub : 0;
+    const int h = mode == COLOR4 ? in->height : s->planeheight[py];
+    const int w = mode == COLOR4 ? in->width  : s->planewidth[px];
+    const int slice_start = (h * jobnr) / nb_jobs;
+    const int slice_end = (h * (jobnr+1)) / nb_jobs;
+    uint16_t *acc = s->acc + (size_t)jobnr * s->size * s->size;
+    int i, j;
+
+    for (i = slice_start; i < slice_end; i++) {
+        const uint8_t *spx = in->data[px] + (i >> vsub) * in->linesize[px];
+        const uint8_t *spy = in->data[py] + (i >> vsub) * in->linesize[py];
+        const uint8_t *spd = in->data[pd] + i * in->linesize[pd];
+
+        for (j = 0; j < w; j++) {
+            const int x = is16 ? FFMIN(((const uint16_t *)spx)[j >> hsub], max) : spx[j >> hsub];
+            const int y = is16 ? FFMIN(((const uint16_t *)spy)[j >> hsub], max) : spy[j >> hsub];
+            const int z = is16 ? ((const uint16_t *)spd)[j] : spd[j];
+            const int pos = y * s->size + x;
+
+            if (z < tmin || z > tmax)
+                continue;
+
+            if (mode == COLOR2)
+                acc[pos] = 1;
+            else if (mode == COLOR4)
+                acc[pos] = FFMAX(acc[pos], z + 1);
+            else
+                acc[pos] = FFMIN(FFMAX(acc[pos], 1) + intensity, max + 1);
+        }
+    }
+}
+
+static av_always_inline void merge(VectorscopeContext *s, AVFrame *out,
+                                   int jobnr, int nb_jobs, int is16)
+{
+    const int size = s->size;
+    const int max = size - 1;
+    const int mid = size / 2;
+    const int mode = s->mode;
+    const int px = s->x, py = s->y, pd = s->pd;
+    const int slice_start = (size * jobnr) / nb_jobs;
+    const int slice_end = (size * (jobnr+1)) / nb_jobs;
+    int i, j, k;
+
+    for (i = slice_start; i < slice_end; i++) {
+        uint8_t *dpx = out->data[px] + i * out->linesize[px];
+        uint8_t *dpy = out->data[py] + i * out->linesize[py];
+        uint8_t *dpd = out->data[pd] + i * out->linesize[pd];
+
+        for (j = 0; j < size; j++) {
+            int d = is16 ? ((uint16_t *)dpd)[j] : dpd[j];
+            int hit = 0;
+
+            for (k = 0; k < s->nb_jobs; k++) {
+                uint16_t *acc = s->acc + (size_t)k * size * size + i * size + j;
+                const int v = *acc;
+
+                if (!v)
+                    continue;
+                *acc = 0;
+                hit = 1;
+                if (mode == COLOR4)
+                    d = FFMAX(d, v - 1);
+                else if (mode != COLOR2)
+                    d = FFMIN(d + v - 1, max);
+            }
+
+            if (!hit)
+                continue;
+
+            if (mode == COLOR2 && !d)
+                d = s->is_yuv ? FFABS(mid - j) + FFABS(mid - i) : FFMIN(j + i, max);
+
+            if (is16) {
+                ((uint16_t *)dpd)[j] = d;
+                if (mode == COLOR2 || mode == COLOR3 || mode == COLOR4) {
+                    ((uint16_t *)dpx)[j] = j;
+                    ((uint16_t *)dpy)[j] = i;
+                }
+            } else {
+                dpd[j] = d;
+                if (mode == COLOR2 || mode == COLOR3 || mode == COLOR4) {
+                    dpx[j] = j;
+                    dpy[j] = i;
+                }
+            }
+        }
+    }
+}
+
+typedef struct ThreadData {
+    AVFrame *in, *out;
+} ThreadData;
+
+/*
+ * Used when there are no accumulation buffers: every job scans the whole
+ * input but only plots the points falling in its own band of output rows,
+ * in the same order as a single thread would.
+ */
+static av_always_inline void scatter(VectorscopeContext *s, AVFrame *in, AVFrame *out,
+                                     int jobnr, int nb_jobs, int mode, int is16)
+{
+    const int px = s->x, py = s->y, pd = s->pd;
+    const int max = s->size - 1;
+    const int mid = s->size / 2;
+    const int intensity = s->intensity;
+    const int tmin = s->tmin;
+    const int tmax = s->tmax;
+    const int hsub = mode == COLOR4 ? s->hsub : 0;
+    const int vsub = mode == COLOR4 ? s->vsub : 0;
+    const int h = mode == COLOR4 ? in->height : s->planeheight[py];
+    const int w = mode == COLOR4 ? in->width  : s->planewidth[px];
+    const int band_start = (s->size * jobnr) / nb_jobs;
+    const int band_end = (s->size * (jobnr+1)) / nb_jobs;
+    int i, j;
+
+    for (i = 0; i < h; i++) {
+        const uint8_t *spx = in->data[px] + (i >> vsub) * in->linesize[px];
+        const uint8_t *spy = in->data[py] + (i >> vsub) * in->linesize[py];
+        const uint8_t *spd = in->data[pd] + i * in->linesize[pd];
+
+        for (j = 0; j < w; j++) {
+            const int y = is16 ? FFMIN(((const uint16_t *)spy)[j >> hsub], max) : spy[j >> hsub];
+            uint8_t *dpx, *dpy, *dpd;
+            int x, z, d;
+
+            if (y < band_start || y >= band_end)
+                continue;
+
+            z = is16 ? ((const uint16_t *)spd)[j] : spd[j];
+            if (z < tmin || z > tmax)
+                continue;
+
+            x = is16 ? FFMIN(((const uint16_t *)spx)[j >> hsub], max) : spx[j >> hsub];
+            dpx = out->data[px] + y * out->linesize[px];
+            dpy = out->data[py] + y * out->linesize[py];
+            dpd = out->data[pd] + y * out->linesize[pd];
+            d = is16 ? ((uint16_t *)dpd)[x] : dpd[x];
+
+            if (mode == COLOR2) {
+                if (!d)
+                    d = s->is_yuv ? FFABS(mid - x) + FFABS(mid - y) : FFMIN(x + y, max);
+            } else if (mode == COLOR4) {
+                d = FFMAX(z, d);
+            } else {
+                d = FFMIN(d + intensity, max);
+            }
+
+            if (is16) {
+                ((uint16_t *)dpd)[x] = d;
+                if (mode != TINT) {
+                    ((uint16_t *)dpx)[x] = x;
+                    ((uint16_t *)dpy)[x] = y;
+                }
+            } else {
+                dpd[x] = d;
+                if (mode != TINT) {
+                    dpx[x] = x;
+                    dpy[x] = y;
+                }
+            }
+        }
+    }
+}
+
+#define DISPATCH_MODE(func, is16, ...)                                          \
+    switch (s->mode) {                                                          \
+    case COLOR:                                                                 \
+    case COLOR5:                                                                \
+    case TINT:   func(__VA_ARGS__, TINT,   is16); break;                        \
+    case COLOR2: func(__VA_ARGS__, COLOR2, is16); break;                        \
+    case COLOR3: func(__VA_ARGS__, COLOR3, is16); break;                        \
+    case COLOR4: func(__VA_ARGS__, COLOR4, is16); break;                        \
+    default:                                                                    \
+        av_assert0(0);                                                          \
+    }
+
+#define SLICE_FUNCS(name, merge_name, scatter_name, is16)                       \
+static int name(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)       \
+{                                                                               \
+    VectorscopeContext *s = ctx->priv;                                          \
+    AVFrame *in = arg;                                                          \
+                                                                                \
+    DISPATCH_MODE(accumulate, is16, s, in, jobnr, nb_jobs)                      \
+    return 0;                                                                   \
+}                                                                               \
+                                                                                \
+static int merge_name(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs) \
+{                                                                               \
+    merge(ctx->priv, arg, jobnr, nb_jobs, is16);                                \
+    return 0;                                                                   \
+}                                                                               \
+                                                                                \
+static int scatter_name(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs) \
+{                                                                               \
+    VectorscopeContext *s = ctx->priv;                                          \
+    ThreadData *td = arg;                                                       \
+                                                                                \
+    DISPATCH_MODE(scatter, is16, s, td->in, td->out, jobnr, nb_jobs)            \
+    return 0;                                                                   \
+}
+
+SLICE_FUNCS(accumulate8,  merge8,  scatter8,  0)
+SLICE_FUNCS(accumulate16, merge16, scatter16, 1)
+
+static void vectorscope16(AVFilterContext *ctx, AVFrame *in, AVFrame *out, int pd)
+{
+    VectorscopeContext *s = ctx->priv;
+    const int dlinesize = out->linesize[0] / 2;
     const int px = s->x, py = s->y;
-    const int h = s->planeheight[py];
-    const int w = s->planewidth[px];
-    const uint16_t *spx = src[px];
-    const uint16_t *spy = src[py];
-    const uint16_t *spd = src[pd];
-    const int hsub = s->hsub;
-    const int vsub = s->vsub;
     uint16_t **dst = (uint16_t **)out->data;
     uint16_t *dpx = dst[px];
     uint16_t *dpy = dst[py];
@@ -438,8 +668,6 @@ static void vectorscope16(VectorscopeContext *s, AVFrame *in, AVFrame *out, int
     uint16_t *dp2 = dst[2];
     const int max = s->size - 1;
     const int mid = s->size / 2;
-    const int tmin = s->tmin;
-    const int tmax = s->tmax;
     int i, j, k;
 
     for (k = 0; k < 4 && dst[k]; k++) {
@@ -449,112 +677,14 @@ static void vectorscope16(VectorscopeContext *s, AVFrame *in, AVFrame *out, int
                         (s->mode == COLOR || s->mode == COLOR5) && k == s->pd ? 0 : s->bg_color[k]);
     }
 
-    switch (s->mode) {
-    case COLOR:
-    case COLOR5:
-    case TINT:
-        for (i = 0; i < h; i++) {
-            const int iwx = i * slinesizex;
-            const int iwy = i * slinesizey;
-            const int iwd = i * slinesized;
-            for (j = 0; j < w; j++) {
-                const int x = FFMIN(spx[iwx + j], max);
-                const int y = FFMIN(spy[iwy + j], max);
-                const int z = spd[iwd + j];
-                const int pos = y * dlinesize + x;
-
-                if (z < tmin || z > tmax)
-                    continue;
-
-                dpd[pos] = FFMIN(dpd[pos] + intensity, max);
-            }
-        }
-        break;
-    case COLOR2:
-        if (s->is_yuv) {
-            for (i = 0; i < h; i++) {
-                const int iw1 = i * slinesizex;
-                const int iw2 = i * slinesizey;
-                const int iwd = i * slinesized;
-                for (j = 0; j < w; j++) {
-                    const int x = FFMIN(spx[iw1 + j], max);
-                    const int y = FFMIN(spy[iw2 + j], max);
-                    const int z = spd[iwd + j];
-                    const int pos = y * dlinesize + x;
-
-                    if (z < tmin || z > tmax)
-                        continue;
-
-                    if (!dpd[pos])
-                        dpd[pos] = FFABS(mid - x) + FFABS(mid - y);
-                    dpx[pos] = x;
-                    dpy[pos] = y;
-                }
-            }
-        } else {
-            for (i = 0; i < h; i++) {
-                const int iw1 = i * slinesizex;
-                const int iw2 = i * slinesizey;
-                const int iwd = i * slinesized;
-                for (j = 0; j < w; j++) {
-                    const int x = FFMIN(spx[iw1 + j], max);
-                    const int y = FFMIN(spy[iw2 + j], max);
-                    const int z = spd[iwd + j];
-                    const int pos = y * dlinesize + x;
-
-                    if (z < tmin || z > tmax)
-                        continue;
-
-                    if (!dpd[pos])
-                        dpd[pos] = FFMIN(x + y, max);
-                    dpx[pos] = x;
-                    dpy[pos] = y;
-                }
-            }
-        }
-        break;
-    case COLOR3:
-        for (i = 0; i < h; i++) {
-            const int iw1 = i * slinesizex;
-            const int iw2 = i * slinesizey;
-            const int iwd = i * slinesized;
-            for (j = 0; j < w; j++) {
-                const int x = FFMIN(spx[iw1 + j], max);
-                const int y = FFMIN(spy[iw2 + j], max);
-                const int z = spd[iwd + j];
-                const int pos = y * dlinesize + x;
-
-                if (z < tmin || z > tmax)
-                    continue;
-
-                dpd[pos] = FFMIN(max, dpd[pos] + intensity);
-                dpx[pos] = x;
-                dpy[pos] = y;
-            }
-        }
-        break;
-    case COLOR4:
-        for (i = 0; i < in->height; i++) {
-            const int iwx = (i >> vsub) * slinesizex;
-            const int iwy = (i >> vsub) * slinesizey;
-            const int iwd = i * slinesized;
-            for (j = 0; j < in->width; j++) {
-                const int x = FFMIN(spx[iwx + (j >> hsub)], max);
-                const int y = FFMIN(spy[iwy + (j >> hsub)], max);
-                const int z = spd[iwd + j];
-                const int pos = y * dlinesize + x;
-
-                if (z < tmin || z > tmax)
-                    continue;
+    if (s->acc) {
+        ff_filter_execute(ctx, accumulate16, in, NULL, s->nb_jobs);
+        ff_filter_execute(ctx, merge16, out, NULL,
+                          FFMIN(s->size, ff_filter_get_nb_threads(ctx)));
+    } else {
+        ThreadData td = { .in = in, .out = out };
 
-                dpd[pos] = FFMAX(z, dpd[pos]);
-                dpx[pos] = x;
-                dpy[pos] = y;
-            }
-        }
-        break;
-    default:
-        av_assert0(0);
+        ff_filter_execute(ctx, scatter16, &td, NULL, s->nb_jobs);
     }
 
     envelope16(s, out);
@@ -614,30 +744,17 @@ static void vectorscope16(VectorscopeContext *s, AVFrame *in, AVFrame *out, int
     }
 }
 
-static void vectorscope8(VectorscopeContext *s, AVFrame *in, AVFrame *out, int pd)
+static void vectorscope8(AVFilterContext *ctx, AVFrame *in, AVFrame *out, int pd)
 {
-    const uint8_t * const *src = (const uint8_t * const *)in->data;
-    const int slinesizex = in->linesize[s->x];
-    const int slinesizey = in->linesize[s->y];
-    const int slinesized = in->linesize[pd];
+    VectorscopeContext *s = ctx->priv;
     const int dlinesize = out->linesize[0];
-    const int intensity = s->intensity;
     const int px = s->x, py = s->y;
-    const int h = s->planeheight[py];
-    const int w = s->planewidth[px];
-    const uint8_t *spx = src[px];
-    const uint8_t *spy = src[py];
-    const uint8_t *spd = src[pd];
-    const int hsub = s->hsub;
-    const int vsub = s->vsub;
     uint8_t **dst = out->data;
     uint8_t *dpx = dst[px];
     uint8_t *dpy = dst[py];
     uint8_t *dpd = dst[pd];
     uint8_t *dp1 = dst[1];
     uint8_t *dp2 = dst[2];
-    const int tmin = s->tmin;
-    const int tmax = s->tmax;
     int i, j, k;
 
     for (k = 0; k < 4 && dst[k]; k++)
@@ -645,112 +762,14 @@ static void vectorscope8(VectorscopeContext *s, AVFrame *in, AVFrame *out, int p
             memset(dst[k] + i * out->linesize[k],
                    (s->mode == COLOR || s->mode == COLOR5) && k == s->pd ? 0 : s->bg_color[k], out->width);
 
-    switch (s->mode) {
-    case COLOR5:
-    case COLOR:
-    case TINT:
-        for (i = 0; i < h; i++) {
-            const int iwx = i * slinesizex;
-            const int iwy = i * slinesizey;
-            const int iwd = i * slinesized;
-            for (j = 0; j < w; j++) {
-                const int x = spx[iwx + j];
-                const int y = spy[iwy + j];
-                const int z = spd[iwd + j];
-                const int pos = y * dlinesize + x;
-
-                if (z < tmin || z > tmax)
-                    continue;
-
-                dpd[pos] = FFMIN(dpd[pos] + intensity, 255);
-            }
-        }
-        break;
-    case COLOR2:
-        if (s->is_yuv) {
-            for (i = 0; i < h; i++) {
-                const int iw1 = i * slinesizex;
-                const int iw2 = i * slinesizey;
-                const int iwd = i * slinesized;
-                for (j = 0; j < w; j++) {
-                    const int x = spx[iw1 + j];
-                    const int y = spy[iw2 + j];
-                    const int z = spd[iwd + j];
-                    const int pos = y * dlinesize + x;
-
-                    if (z < tmin || z > tmax)
-                        continue;
-
-                    if (!dpd[pos])
-                        dpd[pos] = FFABS(128 - x) + FFABS(128 - y);
-                    dpx[pos] = x;
-                    dpy[pos] = y;
-                }
-            }
-        } else {
-            for (i = 0; i < h; i++) {
-                const int iw1 = i * slinesizex;
-                const int iw2 = i * slinesizey;
-                const int iwd = i * slinesized;
-                for (j = 0; j < w; j++) {
-                    const int x = spx[iw1 + j];
-                    const int y = spy[iw2 + j];
-                    const int z = spd[iwd + j];
-                    const int pos = y * dlinesize + x;
-
-                    if (z < tmin || z > tmax)
-                        continue;
-
-                    if (!dpd[pos])
-                        dpd[pos] = FFMIN(x + y, 255);
-                    dpx[pos] = x;
-                    dpy[pos] = y;
-                }
-            }
-        }
-        break;
-    case COLOR3:
-        for (i = 0; i < h; i++) {
-            const int iw1 = i * slinesizex;
-            const int iw2 = i * slinesizey;
-            const int iwd = i * slinesized;
-            for (j = 0; j < w; j++) {
-                const int x = spx[iw1 + j];
-                const int y = spy[iw2 + j];
-                const int z = spd[iwd + j];
-                const int pos = y * dlinesize + x;
-
-                if (z < tmin || z > tmax)
-                    continue;
-
-                dpd[pos] = FFMIN(255, dpd[pos] + intensity);
-                dpx[pos] = x;
-                dpy[pos] = y;
-            }
-        }
-        break;
-    case COLOR4:
-        for (i = 0; i < in->height; i++) {
-            const int iwx = (i >> vsub) * slinesizex;
-            const int iwy = (i >> vsub) * slinesizey;
-            const int iwd = i * slinesized;
-            for (j = 0; j < in->width; j++) {
-                const int x = spx[iwx + (j >> hsub)];
-                const int y = spy[iwy + (j >> hsub)];
-                const int z = spd[iwd + j];
-                const int pos = y * dlinesize + x;
-
-                if (z < tmin || z > tmax)
-                    continue;
+    if (s->acc) {
+        ff_filter_execute(ctx, accumulate8, in, NULL, s->nb_jobs);
+        ff_filter_execute(ctx, merge8, out, NULL,
+                          FFMIN(s->size, ff_filter_get_nb_threads(ctx)));
+    } else {
+        ThreadData td = { .in = in, .out = out };
 
-                dpd[pos] = FFMAX(z, dpd[pos]);
-                dpx[pos] = x;
-                dpy[pos] = y;
-            }
-        }
-        break;
-    default:
-        av_assert0(0);
+        ff_filter_execute(ctx, scatter8, &td, NULL, s->nb_jobs);
     }
 
     envelope(s, out);
@@ -1470,7 +1489,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
     }
     av_frame_copy_props(out, in);
 
-    s->vectorscope(s, in, out, s->pd);
+    s->vectorscope(ctx, in, out, s->pd);
     s->graticulef(s, out, s->x, s->y, s->pd, s->cs);
 
     for (plane = 0; plane < 4; plane++) {
@@ -1568,6 +1587,7 @@ static av_cold void uninit(AVFilterContext *ctx)
 
     av_freep(&s->peak);
     av_freep(&s->peak_memory);
+    av_freep(&s->acc);
 }
 
 static const AVFilterPad inputs[] = {
@@ -1596,5 +1616,6 @@ const AVFilter ff_vf_vectorscope = {
     FILTER_INPUTS(inputs),
     FILTER_OUTPUTS(outputs),
     FILTER_QUERY_FUNC(query_formats),
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
     .process_command = ff_filter_process_command,
 };
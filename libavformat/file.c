@@ -76,6 +76,9 @@ typedef struct FileContext {
     int blocksize;
     int follow;
     int seekable;
+    int prefetch;
+    int64_t pos;            /* position of the next read */
+    int64_t prefetch_end;   /* end of the range already announced to the kernel */
 #if HAVE_DIRENT_H
     DIR *dir;
 #endif
@@ -86,6 +89,7 @@ static const AVOption file_options[] = {
     { "blocksize", "set I/O operation maximum block size", offsetof(FileContext, blocksize), AV_OPT_TYPE_INT, { .i64 = INT_MAX }, 1, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM },
     { "follow", "Follow a file as it is being written", offsetof(FileContext, follow), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
     { "seekable", "Sets if the file is seekable", offsetof(FileContext, seekable), AV_OPT_TYPE_INT, { .i64 = -1 }, -1, 0, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_ENCODING_PARAM },
+    { "prefetch", "set the amount of data to read ahead in the background, in bytes", offsetof(FileContext, prefetch), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, INT_MAX, AV_OPT_FLAG_DECODING_PARAM },
     { NULL }
 };
 
@@ -108,12 +112,35 @@ static const AVClass pipe_class = {
     .version    = LIBAVUTIL_VERSION_INT,
 };
 
+/**
+ * Ask the kernel to start reading the next prefetch bytes in the background
+ * once less than half of the previously announced range is left, so that the
+ * device or network latency overlaps with the processing of the data.
+ */
+static void file_prefetch(FileContext *c)
+{
+#if HAVE_POSIX_FADVISE
+    int64_t start = FFMAX(c->pos, c->prefetch_end);
+
+    if (c->pos + c->prefetch / 2 < c->prefetch_end)
+        return;
+
+    if (posix_fadvise(c->fd, start, c->pos + c->prefetch - start, POSIX_FADV_WILLNEED))
+        c->prefetch = 0;
+    c->prefetch_end = c->pos + c->prefetch;
+#endif
+}
+
 static int file_read(URLContext *h, unsigned char *buf, int size)
 {
     FileContext *c = h->priv_data;
     int ret;
     size = FFMIN(size, c->blocksize);
+    if (c->prefetch)
+        file_prefetch(c);
     ret = read(c->fd, buf, size);
+    if (ret > 0)
+        c->pos += ret;
     if (ret == 0 && c->follow)
         return AVERROR(EAGAIN);
     if (ret == 0)
@@ -261,6 +288,8 @@ static int64_t file_seek(URLContext *h, int64_t pos, int whence)
     }
 
     ret = lseek(c->fd, pos, whence);
+    if (ret >= 0)
+        c->pos = c->prefetch_end = ret;
 
     return ret < 0 ? AVERROR(errno) : ret;
 }
@@ -59,6 +59,7 @@
 #include "libavformat/avio.h"
 #include "libavutil/rational.h"
 #include <libxml/tree.h>
+#include <libxml/xmlreader.h>
 
 #define FF_IMF_UUID_FORMAT                            \
     "urn:uuid:%02hhx%02hhx%02hhx%02hhx-%02hhx%02hhx-" \
@@ -127,8 +128,9 @@ typedef struct FFIMFTrackFileVirtualTrack {
  */
 typedef struct FFIMFMarkerVirtualTrack {
     FFIMFBaseVirtualTrack base;
-    uint32_t resource_count;        /**< Number of Resource elements present in the Virtual Track */
-    FFIMFMarkerResource *resources; /**< Resource elements of the Virtual Track */
+    uint32_t resource_count;          /**< Number of Resource elements present in the Virtual Track */
+    FFIMFMarkerResource *resources;   /**< Resource elements of the Virtual Track */
+    unsigned int resources_alloc_sz;  /**< Size of the resources buffer */
 } FFIMFMarkerVirtualTrack;
 
 /**
@@ -144,17 +146,6 @@ typedef struct FFIMFCPL {
     FFIMFTrackFileVirtualTrack *main_audio_tracks;   /**< Main Audio Virtual Tracks */
 } FFIMFCPL;
 
-/**
- * Parse an IMF CompositionPlaylist element into the FFIMFCPL data structure.
- * @param[in] doc An XML document from which the CPL is read.
- * @param[out] cpl Pointer to a memory area (allocated by the client), where the
- *  function writes a pointer to the newly constructed FFIMFCPL structure (or
- *  NULL if the CPL could not be parsed). The client is responsible for freeing
- *  the FFIMFCPL structure using ff_imf_cpl_free().
- * @return A non-zero value in case of an error.
- */
-int ff_imf_parse_cpl_from_xml_dom(xmlDocPtr doc, FFIMFCPL **cpl);
-
 /**
  * Parse an IMF Composition Playlist document into the FFIMFCPL data structure.
  * @param[in] in The context from which the CPL is read.
@@ -204,4 +195,23 @@ int ff_imf_xml_read_uuid(xmlNodePtr element, uint8_t uuid[16]);
  */
 xmlNodePtr ff_imf_xml_get_child_element_by_name(xmlNodePtr parent, const char *name_utf8);
 
+/**
+ * Creates an XML reader that pulls the document from an AVIOContext
+ * @param[in] in The context from which the document is read.
+ * @param[in] url The base URL of the document, or NULL.
+ * @return A pointer to the reader, or NULL on error. The client is responsible
+ * for freeing the reader using xmlFreeTextReader().
+ */
+xmlTextReaderPtr ff_imf_xml_reader_alloc(AVIOContext *in, const char *url);
+
+/**
+ * Moves an XML reader to the next child element of the element at the given
+ * depth. The reader is either positioned on the start tag of the parent
+ * element or anywhere within one of its child elements, whose remaining
+ * subtree is skipped.
+ * @return 1 if a child element was found, 0 at the end of the parent element,
+ * < 0 AVERROR code on error.
+ */
+int ff_imf_xml_reader_next_child(xmlTextReaderPtr reader, int depth);
+
 #endif
@@ -52,7 +52,6 @@
 
 #include "imf.h"
 #include "libavformat/mxf.h"
-#include "libavutil/bprint.h"
 #include "libavutil/error.h"
 #include <libxml/parser.h>
 
@@ -134,6 +133,51 @@ int ff_imf_xml_read_uint32(xmlNodePtr element, uint32_t *number)
     return ret;
 }
 
+static int imf_xml_reader_read(void *opaque, char *buf, int len)
+{
+    int ret = avio_read(opaque, buf, len);
+
+    if (ret == AVERROR_EOF)
+        return 0;
+    return ret < 0 ? -1 : ret;
+}
+
+xmlTextReaderPtr ff_imf_xml_reader_alloc(AVIOContext *in, const char *url)
+{
+    return xmlReaderForIO(imf_xml_reader_read, NULL, in, url, NULL, 0);
+}
+
+int ff_imf_xml_reader_next_child(xmlTextReaderPtr reader, int depth)
+{
+    int ret;
+
+    if (xmlTextReaderDepth(reader) == depth) {
+        /* positioned on the start tag of the parent element */
+        if (xmlTextReaderIsEmptyElement(reader))
+            return 0;
+        ret = xmlTextReaderRead(reader);
+    } else {
+        /* skip the subtree of the previous child element, if any */
+        ret = xmlTextReaderNext(reader);
+    }
+
+    while (ret == 1) {
+        int cur_depth = xmlTextReaderDepth(reader);
+
+        if (cur_depth <= depth)
+            return 0;
+        if (cur_depth == depth + 1 && xmlTextReaderNodeType(reader) == XML_READER_TYPE_ELEMENT)
+            return 1;
+        ret = xmlTextReaderNext(reader);
+    }
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "XML parsing failed\n");
+        return AVERROR_INVALIDDATA;
+    }
+
+    return 0;
+}
+
 static void imf_base_virtual_track_init(FFIMFBaseVirtualTrack *track)
 {
     memset(track->id_uuid, 0, sizeof(track->id_uuid));
@@ -143,6 +187,7 @@ static void imf_marker_virtual_track_init(FFIMFMarkerVirtualTrack *track)
 {
     imf_base_virtual_track_init((FFIMFBaseVirtualTrack *)track);
     track->resource_count = 0;
+    track->resources_alloc_sz = 0;
     track->resources = NULL;
 }
 
@@ -182,45 +227,6 @@ static void imf_trackfile_resource_init(FFIMFTrackFileResource *rsrc)
     memset(rsrc->track_file_uuid, 0, sizeof(rsrc->track_file_uuid));
 }
 
-static int fill_content_title(xmlNodePtr cpl_element, FFIMFCPL *cpl)
-{
-    xmlNodePtr element = NULL;
-
-    if (!(element = ff_imf_xml_get_child_element_by_name(cpl_element, "ContentTitle"))) {
-        av_log(NULL, AV_LOG_ERROR, "ContentTitle element not found in the IMF CPL\n");
-        return AVERROR_INVALIDDATA;
-    }
-    cpl->content_title_utf8 = xmlNodeListGetString(cpl_element->doc,
-                                                   element->xmlChildrenNode,
-                                                   1);
-
-    return 0;
-}
-
-static int fill_edit_rate(xmlNodePtr cpl_element, FFIMFCPL *cpl)
-{
-    xmlNodePtr element = NULL;
-
-    if (!(element = ff_imf_xml_get_child_element_by_name(cpl_element, "EditRate"))) {
-        av_log(NULL, AV_LOG_ERROR, "EditRate element not found in the IMF CPL\n");
-        return AVERROR_INVALIDDATA;
-    }
-
-    return ff_imf_xml_read_rational(element, &cpl->edit_rate);
-}
-
-static int fill_id(xmlNodePtr cpl_element, FFIMFCPL *cpl)
-{
-    xmlNodePtr element = NULL;
-
-    if (!(element = ff_imf_xml_get_child_element_by_name(cpl_element, "Id"))) {
-        av_log(NULL, AV_LOG_ERROR, "Id element not found in the IMF CPL\n");
-        return AVERROR_INVALIDDATA;
-    }
-
-    return ff_imf_xml_read_uuid(element, cpl->id_uuid);
-}
-
 static int fill_marker(xmlNodePtr marker_elem, FFIMFMarker *marker)
 {
     xmlNodePtr element = NULL;
@@ -367,25 +373,8 @@ static int fill_marker_resource(xmlNodePtr marker_resource_elem,
     return ret;
 }
 
-static int push_marker_sequence(xmlNodePtr marker_sequence_elem, FFIMFCPL *cpl)
+static int get_marker_track(FFIMFCPL *cpl, const uint8_t uuid[16])
 {
-    int ret = 0;
-    uint8_t uuid[16];
-    xmlNodePtr resource_list_elem = NULL;
-    xmlNodePtr resource_elem = NULL;
-    xmlNodePtr track_id_elem = NULL;
-    unsigned long resource_elem_count;
-    void *tmp;
-
-    /* read TrackID element */
-    if (!(track_id_elem = ff_imf_xml_get_child_element_by_name(marker_sequence_elem, "TrackId"))) {
-        av_log(NULL, AV_LOG_ERROR, "TrackId element missing from Sequence\n");
-        return AVERROR_INVALIDDATA;
-    }
-    if (ff_imf_xml_read_uuid(track_id_elem, uuid)) {
-        av_log(NULL, AV_LOG_ERROR, "Invalid TrackId element found in Sequence\n");
-        return AVERROR_INVALIDDATA;
-    }
     av_log(NULL,
            AV_LOG_DEBUG,
            "Processing IMF CPL Marker Sequence for Virtual Track " FF_IMF_UUID_FORMAT "\n",
@@ -397,83 +386,42 @@ static int push_marker_sequence(xmlNodePtr marker_sequence_elem, FFIMFCPL *cpl)
         if (!cpl->main_markers_track)
             return AVERROR(ENOMEM);
         imf_marker_virtual_track_init(cpl->main_markers_track);
-        memcpy(cpl->main_markers_track->base.id_uuid, uuid, sizeof(uuid));
+        memcpy(cpl->main_markers_track->base.id_uuid, uuid, sizeof(cpl->main_markers_track->base.id_uuid));
 
-    } else if (memcmp(cpl->main_markers_track->base.id_uuid, uuid, sizeof(uuid)) != 0) {
+    } else if (memcmp(cpl->main_markers_track->base.id_uuid, uuid, sizeof(cpl->main_markers_track->base.id_uuid)) != 0) {
         av_log(NULL, AV_LOG_ERROR, "Multiple marker virtual tracks were found\n");
         return AVERROR_INVALIDDATA;
     }
 
-    /* process resources */
-    resource_list_elem = ff_imf_xml_get_child_element_by_name(marker_sequence_elem, "ResourceList");
-    if (!resource_list_elem)
-        return 0;
-
-    resource_elem_count = xmlChildElementCount(resource_list_elem);
-    if (resource_elem_count > UINT32_MAX
-        || cpl->main_markers_track->resource_count > UINT32_MAX - resource_elem_count)
-        return AVERROR(ENOMEM);
-    tmp = av_realloc_array(cpl->main_markers_track->resources,
-                           cpl->main_markers_track->resource_count + resource_elem_count,
-                           sizeof(FFIMFMarkerResource));
-    if (!tmp) {
-        av_log(NULL, AV_LOG_ERROR, "Cannot allocate Marker Resources\n");
-        return AVERROR(ENOMEM);
-    }
-    cpl->main_markers_track->resources = tmp;
-
-    resource_elem = xmlFirstElementChild(resource_list_elem);
-    while (resource_elem) {
-        imf_marker_resource_init(&cpl->main_markers_track->resources[cpl->main_markers_track->resource_count]);
-        ret = fill_marker_resource(resource_elem,
-                                   &cpl->main_markers_track->resources[cpl->main_markers_track->resource_count],
-                                   cpl);
-        cpl->main_markers_track->resource_count++;
-        if (ret)
-            return ret;
-
-        resource_elem = xmlNextElementSibling(resource_elem);
-    }
-
-    return ret;
+    return 0;
 }
 
-static int has_stereo_resources(xmlNodePtr element)
+static int get_main_image_2d_track(FFIMFCPL *cpl, const uint8_t uuid[16])
 {
-    if (xmlStrcmp(element->name, "Left") == 0 || xmlStrcmp(element->name, "Right") == 0)
-        return 1;
-
-    element = xmlFirstElementChild(element);
-    while (element) {
-        if (has_stereo_resources(element))
-            return 1;
+    /* create main image virtual track if one does not exist */
+    if (!cpl->main_image_2d_track) {
+        cpl->main_image_2d_track = av_malloc(sizeof(FFIMFTrackFileVirtualTrack));
+        if (!cpl->main_image_2d_track)
+            return AVERROR(ENOMEM);
+        imf_trackfile_virtual_track_init(cpl->main_image_2d_track);
+        memcpy(cpl->main_image_2d_track->base.id_uuid, uuid, sizeof(cpl->main_image_2d_track->base.id_uuid));
 
-        element = xmlNextElementSibling(element);
+    } else if (memcmp(cpl->main_image_2d_track->base.id_uuid, uuid, sizeof(cpl->main_image_2d_track->base.id_uuid)) != 0) {
+        av_log(NULL, AV_LOG_ERROR, "Multiple MainImage virtual tracks found\n");
+        return AVERROR_INVALIDDATA;
     }
+    av_log(NULL,
+           AV_LOG_DEBUG,
+           "Processing IMF CPL Main Image Sequence for Virtual Track " FF_IMF_UUID_FORMAT "\n",
+           UID_ARG(uuid));
 
     return 0;
 }
 
-static int push_main_audio_sequence(xmlNodePtr audio_sequence_elem, FFIMFCPL *cpl)
+static int get_main_audio_track(FFIMFCPL *cpl, const uint8_t uuid[16], FFIMFTrackFileVirtualTrack **vt)
 {
-    int ret = 0;
-    uint8_t uuid[16];
-    xmlNodePtr resource_list_elem = NULL;
-    xmlNodePtr resource_elem = NULL;
-    xmlNodePtr track_id_elem = NULL;
-    unsigned long resource_elem_count;
-    FFIMFTrackFileVirtualTrack *vt = NULL;
     void *tmp;
 
-    /* read TrackID element */
-    if (!(track_id_elem = ff_imf_xml_get_child_element_by_name(audio_sequence_elem, "TrackId"))) {
-        av_log(NULL, AV_LOG_ERROR, "TrackId element missing from audio sequence\n");
-        return AVERROR_INVALIDDATA;
-    }
-    if ((ret = ff_imf_xml_read_uuid(track_id_elem, uuid))) {
-        av_log(NULL, AV_LOG_ERROR, "Invalid TrackId element found in audio sequence\n");
-        return ret;
-    }
     av_log(NULL,
            AV_LOG_DEBUG,
            "Processing IMF CPL Audio Sequence for Virtual Track " FF_IMF_UUID_FORMAT "\n",
@@ -481,234 +429,98 @@ static int push_main_audio_sequence(xmlNodePtr audio_sequence_elem, FFIMFCPL *cp
 
     /* get the main audio virtual track corresponding to the sequence */
     for (uint32_t i = 0; i < cpl->main_audio_track_count; i++) {
-        if (memcmp(cpl->main_audio_tracks[i].base.id_uuid, uuid, sizeof(uuid)) == 0) {
-            vt = &cpl->main_audio_tracks[i];
-            break;
+        if (memcmp(cpl->main_audio_tracks[i].base.id_uuid, uuid, sizeof(cpl->main_audio_tracks[i].base.id_uuid)) == 0) {
+            *vt = &cpl->main_audio_tracks[i];
+            return 0;
         }
     }
 
     /* create a main audio virtual track if none exists for the sequence */
-    if (!vt) {
-        if (cpl->main_audio_track_count == UINT32_MAX)
-            return AVERROR(ENOMEM);
-        tmp = av_realloc_array(cpl->main_audio_tracks,
-                               cpl->main_audio_track_count + 1,
-                               sizeof(FFIMFTrackFileVirtualTrack));
-        if (!tmp)
-            return AVERROR(ENOMEM);
+    if (cpl->main_audio_track_count == UINT32_MAX)
+        return AVERROR(ENOMEM);
+    tmp = av_realloc_array(cpl->main_audio_tracks,
+                           cpl->main_audio_track_count + 1,
+                           sizeof(FFIMFTrackFileVirtualTrack));
+    if (!tmp)
+        return AVERROR(ENOMEM);
 
-        cpl->main_audio_tracks = tmp;
-        vt = &cpl->main_audio_tracks[cpl->main_audio_track_count];
-        imf_trackfile_virtual_track_init(vt);
-        cpl->main_audio_track_count++;
-        memcpy(vt->base.id_uuid, uuid, sizeof(uuid));
-    }
+    cpl->main_audio_tracks = tmp;
+    *vt = &cpl->main_audio_tracks[cpl->main_audio_track_count];
+    imf_trackfile_virtual_track_init(*vt);
+    cpl->main_audio_track_count++;
+    memcpy((*vt)->base.id_uuid, uuid, sizeof((*vt)->base.id_uuid));
 
-    /* process resources */
-    resource_list_elem = ff_imf_xml_get_child_element_by_name(audio_sequence_elem, "ResourceList");
-    if (!resource_list_elem)
-        return 0;
+    return 0;
+}
 
-    resource_elem_count = xmlChildElementCount(resource_list_elem);
-    if (resource_elem_count > UINT32_MAX
-        || vt->resource_count > UINT32_MAX - resource_elem_count)
+/**
+ * Appends a Resource element to a marker virtual track.
+ * @return 0 on success, < 0 AVERROR code on error.
+ */
+static int push_marker_resource(xmlNodePtr resource_elem, FFIMFMarkerVirtualTrack *vt, FFIMFCPL *cpl)
+{
+    void *tmp;
+
+    if (vt->resource_count >= INT_MAX / sizeof(FFIMFMarkerResource) - 1)
         return AVERROR(ENOMEM);
     tmp = av_fast_realloc(vt->resources,
                           &vt->resources_alloc_sz,
-                          (vt->resource_count + resource_elem_count)
-                              * sizeof(FFIMFTrackFileResource));
+                          (vt->resource_count + 1) * sizeof(FFIMFMarkerResource));
     if (!tmp) {
-        av_log(NULL, AV_LOG_ERROR, "Cannot allocate Main Audio Resources\n");
+        av_log(NULL, AV_LOG_ERROR, "Cannot allocate Marker Resources\n");
         return AVERROR(ENOMEM);
     }
     vt->resources = tmp;
 
-    resource_elem = xmlFirstElementChild(resource_list_elem);
-    while (resource_elem) {
-        imf_trackfile_resource_init(&vt->resources[vt->resource_count]);
-        ret = fill_trackfile_resource(resource_elem,
-                                      &vt->resources[vt->resource_count],
-                                      cpl);
-        vt->resource_count++;
-        if (ret) {
-            av_log(NULL, AV_LOG_ERROR, "Invalid Resource\n");
-            continue;
-        }
-
-        resource_elem = xmlNextElementSibling(resource_elem);
-    }
-
-    return ret;
+    imf_marker_resource_init(&vt->resources[vt->resource_count]);
+    /* count the resource even on failure so that its markers get freed */
+    return fill_marker_resource(resource_elem, &vt->resources[vt->resource_count++], cpl);
 }
 
-static int push_main_image_2d_sequence(xmlNodePtr image_sequence_elem, FFIMFCPL *cpl)
+/**
+ * Appends a Resource element to a track file virtual track. Invalid
+ * resources are skipped.
+ * @return 0 on success, < 0 AVERROR code on allocation failure.
+ */
+static int push_trackfile_resource(xmlNodePtr resource_elem, FFIMFTrackFileVirtualTrack *vt, FFIMFCPL *cpl)
 {
-    int ret = 0;
-    uint8_t uuid[16];
-    xmlNodePtr resource_list_elem = NULL;
-    xmlNodePtr resource_elem = NULL;
-    xmlNodePtr track_id_elem = NULL;
     void *tmp;
-    unsigned long resource_elem_count;
 
-    /* skip stereoscopic resources */
-    if (has_stereo_resources(image_sequence_elem)) {
-        av_log(NULL, AV_LOG_ERROR, "Stereoscopic 3D image virtual tracks not supported\n");
-        return AVERROR_PATCHWELCOME;
-    }
-
-    /* read TrackId element*/
-    if (!(track_id_elem = ff_imf_xml_get_child_element_by_name(image_sequence_elem, "TrackId"))) {
-        av_log(NULL, AV_LOG_ERROR, "TrackId element missing from audio sequence\n");
-        return AVERROR_INVALIDDATA;
-    }
-    if ((ret = ff_imf_xml_read_uuid(track_id_elem, uuid))) {
-        av_log(NULL, AV_LOG_ERROR, "Invalid TrackId element found in audio sequence\n");
-        return ret;
-    }
-
-    /* create main image virtual track if one does not exist */
-    if (!cpl->main_image_2d_track) {
-        cpl->main_image_2d_track = av_malloc(sizeof(FFIMFTrackFileVirtualTrack));
-        if (!cpl->main_image_2d_track)
-            return AVERROR(ENOMEM);
-        imf_trackfile_virtual_track_init(cpl->main_image_2d_track);
-        memcpy(cpl->main_image_2d_track->base.id_uuid, uuid, sizeof(uuid));
-
-    } else if (memcmp(cpl->main_image_2d_track->base.id_uuid, uuid, sizeof(uuid)) != 0) {
-        av_log(NULL, AV_LOG_ERROR, "Multiple MainImage virtual tracks found\n");
-        return AVERROR_INVALIDDATA;
-    }
-    av_log(NULL,
-           AV_LOG_DEBUG,
-           "Processing IMF CPL Main Image Sequence for Virtual Track " FF_IMF_UUID_FORMAT "\n",
-           UID_ARG(uuid));
-
-    /* process resources */
-    resource_list_elem = ff_imf_xml_get_child_element_by_name(image_sequence_elem, "ResourceList");
-    if (!resource_list_elem)
-        return 0;
-
-    resource_elem_count = xmlChildElementCount(resource_list_elem);
-    if (resource_elem_count > UINT32_MAX
-        || cpl->main_image_2d_track->resource_count > UINT32_MAX - resource_elem_count
-        || (cpl->main_image_2d_track->resource_count + resource_elem_count)
-            > INT_MAX / sizeof(FFIMFTrackFileResource))
+    if (vt->resource_count >= INT_MAX / sizeof(FFIMFTrackFileResource) - 1)
         return AVERROR(ENOMEM);
-    tmp = av_fast_realloc(cpl->main_image_2d_track->resources,
-                          &cpl->main_image_2d_track->resources_alloc_sz,
-                          (cpl->main_image_2d_track->resource_count + resource_elem_count)
-                              * sizeof(FFIMFTrackFileResource));
+    tmp = av_fast_realloc(vt->resources,
+                          &vt->resources_alloc_sz,
+                          (vt->resource_count + 1) * sizeof(FFIMFTrackFileResource));
     if (!tmp) {
-        av_log(NULL, AV_LOG_ERROR, "Cannot allocate Main Image Resources\n");
+        av_log(NULL, AV_LOG_ERROR, "Cannot allocate Resources\n");
         return AVERROR(ENOMEM);
     }
-    cpl->main_image_2d_track->resources = tmp;
-
-    resource_elem = xmlFirstElementChild(resource_list_elem);
-    while (resource_elem) {
-        imf_trackfile_resource_init(
-            &cpl->main_image_2d_track->resources[cpl->main_image_2d_track->resource_count]);
-        ret = fill_trackfile_resource(resource_elem,
-                                      &cpl->main_image_2d_track->resources[cpl->main_image_2d_track->resource_count],
-                                      cpl);
-        cpl->main_image_2d_track->resource_count++;
-        if (ret) {
-            av_log(NULL, AV_LOG_ERROR, "Invalid Resource\n");
-            continue;
-        }
+    vt->resources = tmp;
 
-        resource_elem = xmlNextElementSibling(resource_elem);
+    imf_trackfile_resource_init(&vt->resources[vt->resource_count]);
+    if (fill_trackfile_resource(resource_elem, &vt->resources[vt->resource_count], cpl)) {
+        av_log(NULL, AV_LOG_ERROR, "Invalid Resource\n");
+        return 0;
     }
+    vt->resource_count++;
 
     return 0;
 }
 
-static int fill_virtual_tracks(xmlNodePtr cpl_element, FFIMFCPL *cpl)
-{
-    int ret = 0;
-    xmlNodePtr segment_list_elem = NULL;
-    xmlNodePtr segment_elem = NULL;
-    xmlNodePtr sequence_list_elem = NULL;
-    xmlNodePtr sequence_elem = NULL;
-
-    if (!(segment_list_elem = ff_imf_xml_get_child_element_by_name(cpl_element, "SegmentList"))) {
-        av_log(NULL, AV_LOG_ERROR, "SegmentList element missing\n");
-        return AVERROR_INVALIDDATA;
-    }
-
-    /* process sequences */
-    segment_elem = xmlFirstElementChild(segment_list_elem);
-    while (segment_elem) {
-        av_log(NULL, AV_LOG_DEBUG, "Processing IMF CPL Segment\n");
-
-        sequence_list_elem = ff_imf_xml_get_child_element_by_name(segment_elem, "SequenceList");
-        if (!segment_list_elem)
-            continue;
-
-        sequence_elem = xmlFirstElementChild(sequence_list_elem);
-        while (sequence_elem) {
-            if (xmlStrcmp(sequence_elem->name, "MarkerSequence") == 0)
-                ret = push_marker_sequence(sequence_elem, cpl);
-
-            else if (xmlStrcmp(sequence_elem->name, "MainImageSequence") == 0)
-                ret = push_main_image_2d_sequence(sequence_elem, cpl);
-
-            else if (xmlStrcmp(sequence_elem->name, "MainAudioSequence") == 0)
-                ret = push_main_audio_sequence(sequence_elem, cpl);
-
-            else
-                av_log(NULL,
-                       AV_LOG_INFO,
-                       "The following Sequence is not supported and is ignored: %s\n",
-                       sequence_elem->name);
-
-            /* abort parsing only if memory error occurred */
-            if (ret == AVERROR(ENOMEM))
-                return ret;
-
-            sequence_elem = xmlNextElementSibling(sequence_elem);
-        }
-
-        segment_elem = xmlNextElementSibling(segment_elem);
-    }
-
-    return ret;
-}
-
-int ff_imf_parse_cpl_from_xml_dom(xmlDocPtr doc, FFIMFCPL **cpl)
+static int has_stereo_resources(xmlNodePtr element)
 {
-    int ret = 0;
-    xmlNodePtr cpl_element = NULL;
+    if (xmlStrcmp(element->name, "Left") == 0 || xmlStrcmp(element->name, "Right") == 0)
+        return 1;
 
-    *cpl = ff_imf_cpl_alloc();
-    if (!*cpl) {
-        ret = AVERROR(ENOMEM);
-        goto cleanup;
-    }
+    element = xmlFirstElementChild(element);
+    while (element) {
+        if (has_stereo_resources(element))
+            return 1;
 
-    cpl_element = xmlDocGetRootElement(doc);
-    if (!cpl_element || xmlStrcmp(cpl_element->name, "CompositionPlaylist")) {
-        av_log(NULL, AV_LOG_ERROR, "The root element of the CPL is not CompositionPlaylist\n");
-        ret = AVERROR_INVALIDDATA;
-        goto cleanup;
+        element = xmlNextElementSibling(element);
     }
 
-    if ((ret = fill_content_title(cpl_element, *cpl)))
-        goto cleanup;
-    if ((ret = fill_id(cpl_element, *cpl)))
-        goto cleanup;
-    if ((ret = fill_edit_rate(cpl_element, *cpl)))
-        goto cleanup;
-    if ((ret = fill_virtual_tracks(cpl_element, *cpl)))
-        goto cleanup;
-
-cleanup:
-    if (*cpl && ret) {
-        ff_imf_cpl_free(*cpl);
-        *cpl = NULL;
-    }
-    return ret;
+    return 0;
 }
 
 static void imf_marker_free(FFIMFMarker *marker)
@@ -792,35 +604,241 @@ void ff_imf_cpl_free(FFIMFCPL *cpl)
     av_freep(&cpl);
 }
 
-int ff_imf_parse_cpl(AVIOContext *in, FFIMFCPL **cpl)
+static xmlNodePtr imf_xml_reader_expand(xmlTextReaderPtr reader)
 {
-    AVBPrint buf;
-    xmlDoc *doc = NULL;
-    int ret = 0;
+    xmlNodePtr element = xmlTextReaderExpand(reader);
 
-    av_bprint_init(&buf, 0, INT_MAX); // xmlReadMemory uses integer length
+    if (!element)
+        av_log(NULL, AV_LOG_ERROR, "XML parsing failed\n");
+    return element;
+}
 
-    ret = avio_read_to_bprint(in, &buf, SIZE_MAX);
-    if (ret < 0 || !avio_feof(in)) {
-        av_log(NULL, AV_LOG_ERROR, "Cannot read IMF CPL\n");
-        if (ret == 0)
-            ret = AVERROR_INVALIDDATA;
-        goto clean_up;
+/**
+ * Reads the resources of a sequence one Resource element at a time, so that
+ * only a single resource subtree is kept in memory.
+ */
+static int read_sequence(xmlTextReaderPtr reader, FFIMFCPL *cpl, const char *name)
+{
+    int depth = xmlTextReaderDepth(reader);
+    int is_marker = !strcmp(name, "MarkerSequence");
+    int is_image = !strcmp(name, "MainImageSequence");
+    FFIMFTrackFileVirtualTrack *vt = NULL;
+    uint32_t resource_count = 0;
+    int has_track = 0, new_track = 0;
+    int ret;
+
+    while ((ret = ff_imf_xml_reader_next_child(reader, depth)) > 0) {
+        const xmlChar *child_name = xmlTextReaderConstLocalName(reader);
+        int child_depth = xmlTextReaderDepth(reader);
+        xmlNodePtr element;
+
+        if (xmlStrcmp(child_name, "TrackId") == 0 && !has_track) {
+            uint8_t uuid[16];
+
+            if (!(element = imf_xml_reader_expand(reader)))
+                return AVERROR_INVALIDDATA;
+            if (ff_imf_xml_read_uuid(element, uuid)) {
+                av_log(NULL, AV_LOG_ERROR, "Invalid TrackId element found in Sequence\n");
+                return AVERROR_INVALIDDATA;
+            }
+            if (is_marker) {
+                ret = get_marker_track(cpl, uuid);
+            } else if (is_image) {
+                new_track = !cpl->main_image_2d_track;
+                ret = get_main_image_2d_track(cpl, uuid);
+                vt = cpl->main_image_2d_track;
+            } else {
+                uint32_t track_count = cpl->main_audio_track_count;
+
+                ret = get_main_audio_track(cpl, uuid, &vt);
+                new_track = cpl->main_audio_track_count != track_count;
+            }
+            if (ret)
+                return ret;
+            if (vt)
+                resource_count = vt->resource_count;
+            has_track = 1;
+        } else if (xmlStrcmp(child_name, "ResourceList") == 0) {
+            if (!has_track) {
+                av_log(NULL, AV_LOG_ERROR, "TrackId element missing from Sequence\n");
+                return AVERROR_INVALIDDATA;
+            }
+
+            while ((ret = ff_imf_xml_reader_next_child(reader, child_depth)) > 0) {
+                if (!(element = imf_xml_reader_expand(reader)))
+                    return AVERROR_INVALIDDATA;
+
+                if (is_marker) {
+                    ret = push_marker_resource(element, cpl->main_markers_track, cpl);
+                } else if (is_image && has_stereo_resources(element)) {
+                    /* drop what this sequence added so far */
+                    av_log(NULL, AV_LOG_ERROR, "Stereoscopic 3D image virtual tracks not supported\n");
+                    vt->resource_count = resource_count;
+                    if (new_track) {
+                        imf_trackfile_virtual_track_free(vt);
+                        av_freep(&cpl->main_image_2d_track);
+                    }
+                    return AVERROR_PATCHWELCOME;
+                } else {
+                    ret = push_trackfile_resource(element, vt, cpl);
+                }
+                if (ret)
+                    return ret;
+            }
+            if (ret < 0)
+                return ret;
+        }
+    }
+
+    if (ret < 0)
+        return ret;
+    if (!has_track) {
+        av_log(NULL, AV_LOG_ERROR, "TrackId element missing from Sequence\n");
+        return AVERROR_INVALIDDATA;
+    }
+
+    return 0;
+}
+
+static int read_segment_list(xmlTextReaderPtr reader, FFIMFCPL *cpl)
+{
+    int depth = xmlTextReaderDepth(reader);
+    int ret, seq_ret = 0;
+
+    while ((ret = ff_imf_xml_reader_next_child(reader, depth)) > 0) {
+        av_log(NULL, AV_LOG_DEBUG, "Processing IMF CPL Segment\n");
+
+        while ((ret = ff_imf_xml_reader_next_child(reader, depth + 1)) > 0) {
+            if (xmlStrcmp(xmlTextReaderConstLocalName(reader), "SequenceList"))
+                continue;
+
+            while ((ret = ff_imf_xml_reader_next_child(reader, depth + 2)) > 0) {
+                const char *name = xmlTextReaderConstLocalName(reader);
+
+                if (!strcmp(name, "MarkerSequence") ||
+                    !strcmp(name, "MainImageSequence") ||
+                    !strcmp(name, "MainAudioSequence"))
+                    seq_ret = read_sequence(reader, cpl, name);
+                else
+                    av_log(NULL,
+                           AV_LOG_INFO,
+                           "The following Sequence is not supported and is ignored: %s\n",
+                           name);
+
+                /* abort parsing only if memory error occurred */
+                if (seq_ret == AVERROR(ENOMEM))
+                    return seq_ret;
+            }
+            if (ret < 0)
+                return ret;
+        }
+        if (ret < 0)
+            return ret;
     }
 
+    return ret < 0 ? ret : seq_ret;
+}
+
+static int read_cpl(xmlTextReaderPtr reader, FFIMFCPL *cpl)
+{
+    int has_id = 0, has_edit_rate = 0, has_segment_list = 0;
+    int ret;
+
+    while ((ret = xmlTextReaderRead(reader)) == 1 &&
+           xmlTextReaderNodeType(reader) != XML_READER_TYPE_ELEMENT)
+        ;
+    if (ret != 1) {
+        av_log(NULL, AV_LOG_ERROR, "XML parsing failed when reading the IMF CPL\n");
+        return AVERROR_INVALIDDATA;
+    }
+    if (xmlStrcmp(xmlTextReaderConstLocalName(reader), "CompositionPlaylist")) {
+        av_log(NULL, AV_LOG_ERROR, "The root element of the CPL is not CompositionPlaylist\n");
+        return AVERROR_INVALIDDATA;
+    }
+
+    while ((ret = ff_imf_xml_reader_next_child(reader, 0)) > 0) {
+        const xmlChar *name = xmlTextReaderConstLocalName(reader);
+        xmlNodePtr element;
+
+        if (xmlStrcmp(name, "SegmentList") == 0 && !has_segment_list) {
+            /* resources inherit the CPL edit rate, which precedes the SegmentList */
+            if (!has_edit_rate) {
+                av_log(NULL, AV_LOG_ERROR, "EditRate element not found in the IMF CPL\n");
+                return AVERROR_INVALIDDATA;
+            }
+            if ((ret = read_segment_list(reader, cpl)))
+                return ret;
+            has_segment_list = 1;
+        } else if (xmlStrcmp(name, "ContentTitle") == 0 && !cpl->content_title_utf8) {
+            if (!(element = imf_xml_reader_expand(reader)))
+                return AVERROR_INVALIDDATA;
+            cpl->content_title_utf8 = xmlNodeListGetString(element->doc, element->xmlChildrenNode, 1);
+        } else if (xmlStrcmp(name, "Id") == 0 && !has_id) {
+            if (!(element = imf_xml_reader_expand(reader)))
+                return AVERROR_INVALIDDATA;
+            if ((ret = ff_imf_xml_read_uuid(element, cpl->id_uuid)))
+                return ret;
+            has_id = 1;
+        } else if (xmlStrcmp(name, "EditRate") == 0 && !has_edit_rate) {
+            if (!(element = imf_xml_reader_expand(reader)))
+                return AVERROR_INVALIDDATA;
+            if ((ret = ff_imf_xml_read_rational(element, &cpl->edit_rate)))
+                return ret;
+            has_edit_rate = 1;
+        }
+    }
+    if (ret < 0)
+        return ret;
+
+    if (!cpl->content_title_utf8) {
+        av_log(NULL, AV_LOG_ERROR, "ContentTitle element not found in the IMF CPL\n");
+        return AVERROR_INVALIDDATA;
+    }
+    if (!has_id) {
+        av_log(NULL, AV_LOG_ERROR, "Id element not found in the IMF CPL\n");
+        return AVERROR_INVALIDDATA;
+    }
+    if (!has_edit_rate) {
+        av_log(NULL, AV_LOG_ERROR, "EditRate element not found in the IMF CPL\n");
+        return AVERROR_INVALIDDATA;
+    }
+    if (!has_segment_list) {
+        av_log(NULL, AV_LOG_ERROR, "SegmentList element missing\n");
+        return AVERROR_INVALIDDATA;
+    }
+
+    return 0;
+}
+
+int ff_imf_parse_cpl(AVIOContext *in, FFIMFCPL **cpl)
+{
+    xmlTextReaderPtr reader;
+    int ret = 0;
+
     LIBXML_TEST_VERSION
 
-    doc = xmlReadMemory(buf.str, buf.len, NULL, NULL, 0);
-    if (!doc) {
-        av_log(NULL,
-                AV_LOG_ERROR,
-                "XML parsing failed when reading the IMF CPL\n");
-        ret = AVERROR_INVALIDDATA;
+    *cpl = ff_imf_cpl_alloc();
+    if (!*cpl)
+        return AVERROR(ENOMEM);
+
+    reader = ff_imf_xml_reader_alloc(in, NULL);
+    if (!reader) {
+        ret = AVERROR(ENOMEM);
         goto clean_up;
     }
 
-    if ((ret = ff_imf_parse_cpl_from_xml_dom(doc, cpl))) {
+    ret = read_cpl(reader, *cpl);
+    if (ret && in->error < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Cannot read IMF CPL\n");
+        ret = in->error;
+    }
+    xmlFreeTextReader(reader);
+
+clean_up:
+    if (ret) {
         av_log(NULL, AV_LOG_ERROR, "Cannot parse IMF CPL\n");
+        ff_imf_cpl_free(*cpl);
+        *cpl = NULL;
     } else {
         av_log(NULL,
                 AV_LOG_INFO,
@@ -832,10 +850,5 @@ int ff_imf_parse_cpl(AVIOContext *in, FFIMFCPL **cpl)
                 UID_ARG((*cpl)->id_uuid));
     }
 
-    xmlFreeDoc(doc);
-
-clean_up:
-    av_bprint_finalize(&buf, NULL);
-
     return ret;
 }
@@ -67,9 +67,10 @@
 #include "internal.h"
 #include "libavcodec/packet.h"
 #include "libavutil/avstring.h"
-#include "libavutil/bprint.h"
+#include "libavutil/fifo.h"
 #include "libavutil/intreadwrite.h"
 #include "libavutil/opt.h"
+#include "libavutil/thread.h"
 #include "mxf.h"
 #include "url.h"
 #include <inttypes.h>
@@ -93,12 +94,22 @@ typedef struct IMFAssetLocator {
 typedef struct IMFAssetLocatorMap {
     uint32_t asset_count;
     IMFAssetLocator *assets;
+    unsigned int assets_alloc_sz;
 } IMFAssetLocatorMap;
 
+enum IMFResourcePrefetchState {
+    IMF_PREFETCH_NONE,      /**< ctx, if any, is owned by the demuxer thread */
+    IMF_PREFETCH_QUEUED,    /**< waiting for a prefetch thread */
+    IMF_PREFETCH_OPENING,   /**< being opened by a prefetch thread */
+    IMF_PREFETCH_DONE,      /**< opened ahead of time, not used yet */
+};
+
 typedef struct IMFVirtualTrackResourcePlaybackCtx {
     IMFAssetLocator *locator;          /**< Location of the resource */
     FFIMFTrackFileResource *resource;  /**< Underlying IMF CPL resource */
     AVFormatContext *ctx;              /**< Context associated with the resource */
+    int64_t ctx_position;              /**< Timestamp ctx was last sought to, or < 0 if unknown */
+    enum IMFResourcePrefetchState prefetch_state; /**< Protected by IMFContext.prefetch_lock */
     AVRational start_time;             /**< inclusive start time of the resource on the CPL timeline (s) */
     AVRational end_time;               /**< exclusive end time of the resource on the CPL timeline (s) */
     AVRational ts_offset;              /**< start_time minus the entry point into the resource (s) */
@@ -125,6 +136,17 @@ typedef struct IMFContext {
     IMFAssetLocatorMap asset_locator_map;
     uint32_t track_count;
     IMFVirtualTrackPlaybackCtx **tracks;
+    int prefetch;                   /**< Number of resources to open ahead in each track */
+    int prefetch_threads;           /**< Maximum number of resources opened concurrently */
+#if HAVE_THREADS
+    pthread_t *prefetch_workers;
+    int nb_prefetch_workers;
+    AVFifo *prefetch_queue;         /**< IMFVirtualTrackResourcePlaybackCtx pointers to open */
+    pthread_mutex_t prefetch_lock;
+    pthread_cond_t prefetch_cond;
+    int prefetch_lock_init;
+    int prefetch_exit;
+#endif
 } IMFContext;
 
 static int imf_uri_is_url(const char *string)
@@ -174,98 +196,128 @@ static int imf_time_to_ts(int64_t *ts, AVRational t, AVRational time_base)
 }
 
 /**
- * Parse a ASSETMAP XML file to extract the UUID-URI mapping of assets.
+ * Append the asset locator described by an Asset element of an ASSETMAP.
  * @param s the current format context, if any (can be NULL).
- * @param doc the XML document to be parsed.
+ * @param asset_element the Asset element to be parsed.
  * @param asset_map pointer on the IMFAssetLocatorMap to fill.
  * @param base_url the url of the asset map XML file, if any (can be NULL).
  * @return a negative value in case of error, 0 otherwise.
  */
-static int parse_imf_asset_map_from_xml_dom(AVFormatContext *s,
-                                            xmlDocPtr doc,
-                                            IMFAssetLocatorMap *asset_map,
-                                            const char *base_url)
+static int push_asset_locator(AVFormatContext *s,
+                              xmlNodePtr asset_element,
+                              IMFAssetLocatorMap *asset_map,
+                              const char *base_url)
 {
-    xmlNodePtr asset_map_element = NULL;
     xmlNodePtr node = NULL;
-    xmlNodePtr asset_element = NULL;
-    unsigned long elem_count;
     char *uri;
-    int ret = 0;
     IMFAssetLocator *asset = NULL;
     void *tmp;
 
-    asset_map_element = xmlDocGetRootElement(doc);
+    if (asset_map->asset_count >= INT_MAX / sizeof(IMFAssetLocator) - 1)
+        return AVERROR(ENOMEM);
+    tmp = av_fast_realloc(asset_map->assets,
+                          &asset_map->assets_alloc_sz,
+                          (asset_map->asset_count + 1) * sizeof(IMFAssetLocator));
+    if (!tmp) {
+        av_log(s, AV_LOG_ERROR, "Cannot allocate IMF asset locators\n");
+        return AVERROR(ENOMEM);
+    }
+    asset_map->assets = tmp;
 
-    if (!asset_map_element) {
-        av_log(s, AV_LOG_ERROR, "Unable to parse asset map XML - missing root node\n");
+    asset = &(asset_map->assets[asset_map->asset_count]);
+
+    if (!(node = ff_imf_xml_get_child_element_by_name(asset_element, "Id")) ||
+        ff_imf_xml_read_uuid(node, asset->uuid)) {
+        av_log(s, AV_LOG_ERROR, "Could not parse UUID from asset in asset map.\n");
         return AVERROR_INVALIDDATA;
     }
 
-    if (asset_map_element->type != XML_ELEMENT_NODE || av_strcasecmp(asset_map_element->name, "AssetMap")) {
-        av_log(s, AV_LOG_ERROR, "Unable to parse asset map XML - wrong root node name[%s] type[%d]\n",
-               asset_map_element->name, (int)asset_map_element->type);
+    av_log(s, AV_LOG_DEBUG, "Found asset id: " FF_IMF_UUID_FORMAT "\n", UID_ARG(asset->uuid));
+
+    if (!(node = ff_imf_xml_get_child_element_by_name(asset_element, "ChunkList"))) {
+        av_log(s, AV_LOG_ERROR, "Unable to parse asset map XML - missing ChunkList node\n");
         return AVERROR_INVALIDDATA;
     }
 
-    /* parse asset locators */
-    if (!(node = ff_imf_xml_get_child_element_by_name(asset_map_element, "AssetList"))) {
-        av_log(s, AV_LOG_ERROR, "Unable to parse asset map XML - missing AssetList node\n");
+    if (!(node = ff_imf_xml_get_child_element_by_name(node, "Chunk"))) {
+        av_log(s, AV_LOG_ERROR, "Unable to parse asset map XML - missing Chunk node\n");
         return AVERROR_INVALIDDATA;
     }
-    elem_count = xmlChildElementCount(node);
-    if (elem_count > UINT32_MAX
-        || asset_map->asset_count > UINT32_MAX - elem_count)
-        return AVERROR(ENOMEM);
-    tmp = av_realloc_array(asset_map->assets,
-                           elem_count + asset_map->asset_count,
-                           sizeof(IMFAssetLocator));
-    if (!tmp) {
-        av_log(s, AV_LOG_ERROR, "Cannot allocate IMF asset locators\n");
+
+    uri = xmlNodeGetContent(ff_imf_xml_get_child_element_by_name(node, "Path"));
+    if (!imf_uri_is_url(uri) && !imf_uri_is_unix_abs_path(uri) && !imf_uri_is_dos_abs_path(uri))
+        asset->absolute_uri = av_append_path_component(base_url, uri);
+    else
+        asset->absolute_uri = av_strdup(uri);
+    xmlFree(uri);
+    if (!asset->absolute_uri)
         return AVERROR(ENOMEM);
-    }
-    asset_map->assets = tmp;
 
-    asset_element = xmlFirstElementChild(node);
-    while (asset_element) {
-        if (av_strcasecmp(asset_element->name, "Asset") != 0)
-            continue;
+    av_log(s, AV_LOG_DEBUG, "Found asset absolute URI: %s\n", asset->absolute_uri);
 
-        asset = &(asset_map->assets[asset_map->asset_count]);
+    asset_map->asset_count++;
 
-        if (ff_imf_xml_read_uuid(ff_imf_xml_get_child_element_by_name(asset_element, "Id"), asset->uuid)) {
-            av_log(s, AV_LOG_ERROR, "Could not parse UUID from asset in asset map.\n");
-            return AVERROR_INVALIDDATA;
-        }
+    return 0;
+}
 
-        av_log(s, AV_LOG_DEBUG, "Found asset id: " FF_IMF_UUID_FORMAT "\n", UID_ARG(asset->uuid));
+/**
+ * Parse a ASSETMAP XML document one Asset element at a time.
+ * @param s the current format context, if any (can be NULL).
+ * @param reader the XML reader from which the document is read.
+ * @param asset_map pointer on the IMFAssetLocatorMap to fill.
+ * @param base_url the url of the asset map XML file, if any (can be NULL).
+ * @return a negative value in case of error, 0 otherwise.
+ */
+static int parse_imf_asset_map_from_xml_reader(AVFormatContext *s,
+                                               xmlTextReaderPtr reader,
+                                               IMFAssetLocatorMap *asset_map,
+                                               const char *base_url)
+{
+    int has_asset_list = 0;
+    int ret;
 
-        if (!(node = ff_imf_xml_get_child_element_by_name(asset_element, "ChunkList"))) {
-            av_log(s, AV_LOG_ERROR, "Unable to parse asset map XML - missing ChunkList node\n");
-            return AVERROR_INVALIDDATA;
-        }
+    while ((ret = xmlTextReaderRead(reader)) == 1 &&
+           xmlTextReaderNodeType(reader) != XML_READER_TYPE_ELEMENT)
+        ;
+    if (ret != 1) {
+        av_log(s, AV_LOG_ERROR, "Unable to parse asset map XML - missing root node\n");
+        return AVERROR_INVALIDDATA;
+    }
 
-        if (!(node = ff_imf_xml_get_child_element_by_name(node, "Chunk"))) {
-            av_log(s, AV_LOG_ERROR, "Unable to parse asset map XML - missing Chunk node\n");
-            return AVERROR_INVALIDDATA;
-        }
+    if (av_strcasecmp(xmlTextReaderConstLocalName(reader), "AssetMap")) {
+        av_log(s, AV_LOG_ERROR, "Unable to parse asset map XML - wrong root node name[%s]\n",
+               xmlTextReaderConstLocalName(reader));
+        return AVERROR_INVALIDDATA;
+    }
 
-        uri = xmlNodeGetContent(ff_imf_xml_get_child_element_by_name(node, "Path"));
-        if (!imf_uri_is_url(uri) && !imf_uri_is_unix_abs_path(uri) && !imf_uri_is_dos_abs_path(uri))
-            asset->absolute_uri = av_append_path_component(base_url, uri);
-        else
-            asset->absolute_uri = av_strdup(uri);
-        xmlFree(uri);
-        if (!asset->absolute_uri)
-            return AVERROR(ENOMEM);
+    while ((ret = ff_imf_xml_reader_next_child(reader, 0)) > 0) {
+        if (has_asset_list || xmlStrcmp(xmlTextReaderConstLocalName(reader), "AssetList"))
+            continue;
+        has_asset_list = 1;
 
-        av_log(s, AV_LOG_DEBUG, "Found asset absolute URI: %s\n", asset->absolute_uri);
+        while ((ret = ff_imf_xml_reader_next_child(reader, 1)) > 0) {
+            xmlNodePtr asset_element;
 
-        asset_map->asset_count++;
-        asset_element = xmlNextElementSibling(asset_element);
+            if (av_strcasecmp(xmlTextReaderConstLocalName(reader), "Asset") != 0)
+                continue;
+
+            if (!(asset_element = xmlTextReaderExpand(reader)))
+                return AVERROR_INVALIDDATA;
+            if ((ret = push_asset_locator(s, asset_element, asset_map, base_url)))
+                return ret;
+        }
+        if (ret < 0)
+            return ret;
     }
+    if (ret < 0)
+        return ret;
 
-    return ret;
+    if (!has_asset_list) {
+        av_log(s, AV_LOG_ERROR, "Unable to parse asset map XML - missing AssetList node\n");
+        return AVERROR_INVALIDDATA;
+    }
+
+    return 0;
 }
 
 /**
@@ -275,6 +327,7 @@ static void imf_asset_locator_map_init(IMFAssetLocatorMap *asset_map)
 {
     asset_map->assets = NULL;
     asset_map->asset_count = 0;
+    asset_map->assets_alloc_sz = 0;
 }
 
 /**
@@ -292,9 +345,8 @@ static int parse_assetmap(AVFormatContext *s, const char *url)
 {
     IMFContext *c = s->priv_data;
     AVIOContext *in = NULL;
-    struct AVBPrint buf;
     AVDictionary *opts = NULL;
-    xmlDoc *doc = NULL;
+    xmlTextReaderPtr reader = NULL;
     const char *base_url;
     char *tmp_str = NULL;
     int ret;
@@ -307,16 +359,6 @@ static int parse_assetmap(AVFormatContext *s, const char *url)
     if (ret < 0)
         return ret;
 
-    av_bprint_init(&buf, 0, INT_MAX); // xmlReadMemory uses integer length
-
-    ret = avio_read_to_bprint(in, &buf, SIZE_MAX);
-    if (ret < 0 || !avio_feof(in)) {
-        av_log(s, AV_LOG_ERROR, "Unable to read to asset map '%s'\n", url);
-        if (ret == 0)
-            ret = AVERROR_INVALIDDATA;
-        goto clean_up;
-    }
-
     LIBXML_TEST_VERSION
 
     tmp_str = av_strdup(url);
@@ -326,20 +368,26 @@ static int parse_assetmap(AVFormatContext *s, const char *url)
     }
     base_url = av_dirname(tmp_str);
 
-    doc = xmlReadMemory(buf.str, buf.len, url, NULL, 0);
+    reader = ff_imf_xml_reader_alloc(in, url);
+    if (!reader) {
+        ret = AVERROR(ENOMEM);
+        goto clean_up;
+    }
 
-    ret = parse_imf_asset_map_from_xml_dom(s, doc, &c->asset_locator_map, base_url);
+    ret = parse_imf_asset_map_from_xml_reader(s, reader, &c->asset_locator_map, base_url);
+    if (ret && in->error < 0) {
+        av_log(s, AV_LOG_ERROR, "Unable to read to asset map '%s'\n", url);
+        ret = in->error;
+    }
     if (!ret)
         av_log(s, AV_LOG_DEBUG, "Found %d assets from %s\n",
                c->asset_locator_map.asset_count, url);
 
-    xmlFreeDoc(doc);
-
 clean_up:
+    xmlFreeTextReader(reader);
     if (tmp_str)
         av_freep(&tmp_str);
     ff_format_io_close(s, &in);
-    av_bprint_finalize(&buf, NULL);
     return ret;
 }
 
@@ -352,22 +400,16 @@ static IMFAssetLocator *find_asset_map_locator(IMFAssetLocatorMap *asset_map, FF
     return NULL;
 }
 
-static int open_track_resource_context(AVFormatContext *s,
-                                       IMFVirtualTrackPlaybackCtx *track,
-                                       int32_t resource_index)
+/**
+ * Open the track file of a resource. Safe to call from a prefetch thread as
+ * long as track_resource is not accessed by anyone else.
+ */
+static int open_track_resource_input(AVFormatContext *s,
+                                     IMFVirtualTrackResourcePlaybackCtx *track_resource)
 {
     IMFContext *c = s->priv_data;
     int ret = 0;
-    int64_t seek_offset = 0;
     AVDictionary *opts = NULL;
-    AVStream *st;
-    IMFVirtualTrackResourcePlaybackCtx *track_resource = track->resources + resource_index;
-
-    if (track_resource->ctx) {
-        av_log(s, AV_LOG_DEBUG, "Input context already opened for %s.\n",
-               track_resource->locator->absolute_uri);
-        return 0;
-    }
 
     track_resource->ctx = avformat_alloc_context();
     if (!track_resource->ctx)
@@ -405,6 +447,33 @@ static int open_track_resource_context(AVFormatContext *s,
         goto cleanup;
     }
 
+    track_resource->ctx_position = 0;
+
+    return 0;
+
+cleanup:
+    av_dict_free(&opts);
+    avformat_free_context(track_resource->ctx);
+    track_resource->ctx = NULL;
+    return ret;
+}
+
+static int open_track_resource_context(AVFormatContext *s,
+                                       IMFVirtualTrackPlaybackCtx *track,
+                                       int32_t resource_index)
+{
+    int ret = 0;
+    int64_t seek_offset = 0;
+    AVStream *st;
+    IMFVirtualTrackResourcePlaybackCtx *track_resource = track->resources + resource_index;
+
+    if (track_resource->ctx) {
+        av_log(s, AV_LOG_DEBUG, "Input context already opened for %s.\n",
+               track_resource->locator->absolute_uri);
+    } else if ((ret = open_track_resource_input(s, track_resource)) < 0) {
+        return ret;
+    }
+
     st = track_resource->ctx->streams[0];
 
     /* Determine the seek offset into the Track File, taking into account:
@@ -418,7 +487,7 @@ static int open_track_resource_context(AVFormatContext *s,
                "and composition timeline position: " AVRATIONAL_FORMAT "\n",
                AVRATIONAL_ARG(st->time_base), AVRATIONAL_ARG(track->current_timestamp));
 
-    if (seek_offset) {
+    if (seek_offset != track_resource->ctx_position) {
         av_log(s, AV_LOG_DEBUG, "Seek at resource %s entry point: %" PRIi64 "\n",
                track_resource->locator->absolute_uri, seek_offset);
         ret = avformat_seek_file(track_resource->ctx, 0, seek_offset, seek_offset, seek_offset, 0);
@@ -433,15 +502,248 @@ static int open_track_resource_context(AVFormatContext *s,
             return ret;
         }
     }
+    track_resource->ctx_position = seek_offset;
 
     return 0;
+}
+
+#if HAVE_THREADS
+static void *imf_prefetch_worker(void *arg)
+{
+    AVFormatContext *s = arg;
+    IMFContext *c = s->priv_data;
+    IMFVirtualTrackResourcePlaybackCtx *track_resource;
+
+    pthread_mutex_lock(&c->prefetch_lock);
+    while (!c->prefetch_exit) {
+        if (av_fifo_read(c->prefetch_queue, &track_resource, 1) < 0) {
+            pthread_cond_wait(&c->prefetch_cond, &c->prefetch_lock);
+            continue;
+        }
+        /* skip resources dequeued by the demuxer in the meantime */
+        if (track_resource->prefetch_state != IMF_PREFETCH_QUEUED)
+            continue;
+
+        track_resource->prefetch_state = IMF_PREFETCH_OPENING;
+        pthread_mutex_unlock(&c->prefetch_lock);
+
+        av_log(s, AV_LOG_DEBUG, "Prefetching %s\n", track_resource->locator->absolute_uri);
+        open_track_resource_input(s, track_resource);
+
+        pthread_mutex_lock(&c->prefetch_lock);
+        /* on failure the demuxer retries and reports the error when it gets there */
+        track_resource->prefetch_state = track_resource->ctx ? IMF_PREFETCH_DONE : IMF_PREFETCH_NONE;
+        pthread_cond_broadcast(&c->prefetch_cond);
+    }
+    pthread_mutex_unlock(&c->prefetch_lock);
+
+    return NULL;
+}
+
+static int imf_prefetch_init(AVFormatContext *s)
+{
+    IMFContext *c = s->priv_data;
+    int ret;
+
+    c->prefetch_queue = av_fifo_alloc2(c->prefetch, sizeof(IMFVirtualTrackResourcePlaybackCtx *),
+                                       AV_FIFO_FLAG_AUTO_GROW);
+    c->prefetch_workers = av_calloc(c->prefetch_threads, sizeof(*c->prefetch_workers));
+    if (!c->prefetch_queue || !c->prefetch_workers)
+        return AVERROR(ENOMEM);
+
+    if ((ret = pthread_mutex_init(&c->prefetch_lock, NULL))) {
+        return AVERROR(ret);
+    }
+    if ((ret = pthread_cond_init(&c->prefetch_cond, NULL))) {
+        pthread_mutex_destroy(&c->prefetch_lock);
+        return AVERROR(ret);
+    }
+    c->prefetch_lock_init = 1;
+
+    for (; c->nb_prefetch_workers < c->prefetch_threads; c->nb_prefetch_workers++) {
+        ret = pthread_create(&c->prefetch_workers[c->nb_prefetch_workers], NULL,
+                             imf_prefetch_worker, s);
+        if (ret)
+            return AVERROR(ret);
+    }
+
+    return 0;
+}
+
+static void imf_prefetch_uninit(AVFormatContext *s)
+{
+    IMFContext *c = s->priv_data;
+
+    if (c->prefetch_lock_init) {
+        pthread_mutex_lock(&c->prefetch_lock);
+        c->prefetch_exit = 1;
+        pthread_cond_broadcast(&c->prefetch_cond);
+        pthread_mutex_unlock(&c->prefetch_lock);
+    }
+    for (int i = 0; i < c->nb_prefetch_workers; i++)
+        pthread_join(c->prefetch_workers[i], NULL);
+    if (c->prefetch_lock_init) {
+        pthread_cond_destroy(&c->prefetch_cond);
+        pthread_mutex_destroy(&c->prefetch_lock);
+    }
+    c->nb_prefetch_workers = 0;
+    c->prefetch_lock_init = 0;
+    av_freep(&c->prefetch_workers);
+    av_fifo_freep2(&c->prefetch_queue);
+}
+
+/**
+ * Take back a resource from the prefetch threads before using it,
+ * waiting for it if it is currently being opened.
+ */
+static void imf_prefetch_claim(IMFContext *c, IMFVirtualTrackResourcePlaybackCtx *track_resource)
+{
+    if (!c->prefetch_lock_init)
+        return;
+
+    pthread_mutex_lock(&c->prefetch_lock);
+    while (track_resource->prefetch_state == IMF_PREFETCH_OPENING)
+        pthread_cond_wait(&c->prefetch_cond, &c->prefetch_lock);
+    track_resource->prefetch_state = IMF_PREFETCH_NONE;
+    pthread_mutex_unlock(&c->prefetch_lock);
+}
+
+/**
+ * Queue the prefetch resources starting at first for opening in the background,
+ * and release the contexts prefetched for resources that left that window.
+ */
+static void imf_prefetch_update(AVFormatContext *s, IMFVirtualTrackPlaybackCtx *track,
+                                uint32_t first)
+{
+    IMFContext *c = s->priv_data;
+    uint32_t current = track->current_resource_index >= 0 ? track->current_resource_index : first;
+
+    if (!c->prefetch_lock_init)
+        return;
+
+    pthread_mutex_lock(&c->prefetch_lock);
+    for (uint32_t i = 0; i < track->resource_count; i++) {
+        IMFVirtualTrackResourcePlaybackCtx *track_resource = track->resources + i;
+
+        if (i >= first && i - first < (unsigned)c->prefetch) {
+            int shared = 0;
+
+            /* resources reading the same track file inherit the demuxer of the previous one */
+            for (uint32_t j = FFMIN(current, first); j < i && !shared; j++)
+                shared = track->resources[j].locator == track_resource->locator;
+
+            if (!shared && track_resource->prefetch_state == IMF_PREFETCH_NONE && !track_resource->ctx &&
+                av_fifo_write(c->prefetch_queue, &track_resource, 1) >= 0)
+                track_resource->prefetch_state = IMF_PREFETCH_QUEUED;
+        } else if (track_resource->prefetch_state == IMF_PREFETCH_QUEUED) {
+            track_resource->prefetch_state = IMF_PREFETCH_NONE;
+        } else if (track_resource->prefetch_state == IMF_PREFETCH_DONE) {
+            AVFormatContext *ctx = track_resource->ctx;
+
+            track_resource->ctx = NULL;
+            track_resource->prefetch_state = IMF_PREFETCH_NONE;
+            /* closing may block on I/O, do not hold up the prefetch threads */
+            pthread_mutex_unlock(&c->prefetch_lock);
+            avformat_close_input(&ctx);
+            pthread_mutex_lock(&c->prefetch_lock);
+        }
+    }
+    pthread_cond_broadcast(&c->prefetch_cond);
+    pthread_mutex_unlock(&c->prefetch_lock);
+}
+
+/**
+ * Withdraw a resource from the prefetch queue.
+ * @return 0 if it is being or has been opened by a prefetch thread, 1 otherwise
+ */
+static int imf_prefetch_cancel(IMFContext *c, IMFVirtualTrackResourcePlaybackCtx *track_resource)
+{
+    int ret;
+
+    if (!c->prefetch_lock_init)
+        return 1;
+
+    pthread_mutex_lock(&c->prefetch_lock);
+    if (track_resource->prefetch_state == IMF_PREFETCH_QUEUED)
+        track_resource->prefetch_state = IMF_PREFETCH_NONE;
+    ret = track_resource->prefetch_state == IMF_PREFETCH_NONE;
+    pthread_mutex_unlock(&c->prefetch_lock);
 
-cleanup:
-    av_dict_free(&opts);
-    avformat_free_context(track_resource->ctx);
-    track_resource->ctx = NULL;
     return ret;
 }
+#else
+static void imf_prefetch_claim(IMFContext *c, IMFVirtualTrackResourcePlaybackCtx *track_resource)
+{
+}
+
+static int imf_prefetch_cancel(IMFContext *c, IMFVirtualTrackResourcePlaybackCtx *track_resource)
+{
+    return 1;
+}
+
+static void imf_prefetch_update(AVFormatContext *s, IMFVirtualTrackPlaybackCtx *track,
+                                uint32_t first)
+{
+}
+#endif
+
+/**
+ * Release the demuxer of a resource the track is leaving. Rather than being
+ * closed, it is handed over to the next resource of the track reading the same
+ * track file, which seeks it when it becomes current.
+ */
+static void release_track_resource_context(AVFormatContext *s,
+                                           IMFVirtualTrackPlaybackCtx *track,
+                                           int32_t resource_index)
+{
+    IMFVirtualTrackResourcePlaybackCtx *track_resource = track->resources + resource_index;
+
+    if (!track_resource->ctx)
+        return;
+
+    for (uint32_t i = resource_index + 1; i < track->resource_count; i++) {
+        IMFVirtualTrackResourcePlaybackCtx *next = track->resources + i;
+
+        if (next->locator != track_resource->locator)
+            continue;
+        /* already has a demuxer of its own; ctx may only be read once
+         * the prefetch threads are done with it */
+        if (!imf_prefetch_cancel(s->priv_data, next) || next->ctx)
+            break;
+
+        av_log(s, AV_LOG_DEBUG, "Reusing %s input context for resource %" PRIu32 " of track %d\n",
+               track_resource->locator->absolute_uri, i, track->index);
+        next->ctx = track_resource->ctx;
+        next->ctx_position = track_resource->ctx_position;
+        track_resource->ctx = NULL;
+        return;
+    }
+
+    if (resource_index > 0)
+        avformat_close_input(&track_resource->ctx);
+}
+
+/**
+ * Close the demuxers held by the resources outside of the window starting at
+ * first, such as the ones handed over by release_track_resource_context()
+ * before a seek. Resources still being opened in the background are closed
+ * by imf_prefetch_update() once they are done.
+ */
+static void release_track_resources_outside(AVFormatContext *s,
+                                            IMFVirtualTrackPlaybackCtx *track,
+                                            uint32_t first)
+{
+    IMFContext *c = s->priv_data;
+
+    for (uint32_t i = 0; i < track->resource_count; i++) {
+        IMFVirtualTrackResourcePlaybackCtx *track_resource = track->resources + i;
+
+        if (i >= first && i - first < (unsigned)FFMAX(c->prefetch, 1))
+            continue;
+        if (imf_prefetch_cancel(c, track_resource) && track_resource->ctx)
+            avformat_close_input(&track_resource->ctx);
+    }
+}
 
 static int open_track_file_resource(AVFormatContext *s,
                                     FFIMFTrackFileResource *track_file_resource,
@@ -482,6 +784,8 @@ static int open_track_file_resource(AVFormatContext *s,
         vt_ctx.locator = asset_locator;
         vt_ctx.resource = track_file_resource;
         vt_ctx.ctx = NULL;
+        vt_ctx.ctx_position = -1;
+        vt_ctx.prefetch_state = IMF_PREFETCH_NONE;
         vt_ctx.start_time = track->duration;
         vt_ctx.ts_offset = av_sub_q(vt_ctx.start_time,
                                     av_div_q(av_make_q((int)track_file_resource->base.entry_point, 1),
@@ -676,6 +980,15 @@ static int imf_read_header(AVFormatContext *s)
     if ((ret = open_cpl_tracks(s)))
         return ret;
 
+    if (c->prefetch) {
+#if HAVE_THREADS
+        if ((ret = imf_prefetch_init(s)) < 0)
+            return ret;
+#else
+        av_log(s, AV_LOG_WARNING, "Resource prefetching requires threads, ignoring\n");
+#endif
+    }
+
     av_log(s, AV_LOG_DEBUG, "parsed IMF package\n");
 
     return 0;
@@ -706,8 +1019,40 @@ static IMFVirtualTrackPlaybackCtx *get_next_track_with_minimum_timestamp(AVForma
     return track;
 }
 
+/**
+ * Find the resource of a track containing a timestamp.
+ * @return the index of the resource, or track->resource_count if the
+ *         timestamp is past the end of the track
+ */
+static uint32_t find_resource_for_timestamp(IMFVirtualTrackPlaybackCtx *track, AVRational timestamp)
+{
+    uint32_t a = 0, b = track->resource_count;
+
+    /* the current resource is the one wanted for all but its first packet */
+    if (track->current_resource_index >= 0) {
+        IMFVirtualTrackResourcePlaybackCtx *current = track->resources + track->current_resource_index;
+
+        if (av_cmp_q(current->start_time, timestamp) <= 0 && av_cmp_q(current->end_time, timestamp) > 0)
+            return track->current_resource_index;
+    }
+
+    /* end times are increasing: look for the first one past timestamp */
+    while (a < b) {
+        uint32_t m = a + (b - a) / 2;
+
+        if (av_cmp_q(track->resources[m].end_time, timestamp) > 0)
+            b = m;
+        else
+            a = m + 1;
+    }
+
+    return a;
+}
+
 static int get_resource_context_for_timestamp(AVFormatContext *s, IMFVirtualTrackPlaybackCtx *track, IMFVirtualTrackResourcePlaybackCtx **resource)
 {
+    uint32_t i;
+
     *resource = NULL;
 
     if (av_cmp_q(track->current_timestamp, track->duration) >= 0) {
@@ -721,33 +1066,34 @@ static int get_resource_context_for_timestamp(AVFormatContext *s, IMFVirtualTrac
            track->index,
            av_q2d(track->current_timestamp),
            av_q2d(track->duration));
-    for (uint32_t i = 0; i < track->resource_count; i++) {
-
-        if (av_cmp_q(track->resources[i].end_time, track->current_timestamp) > 0) {
-            av_log(s, AV_LOG_DEBUG, "Found resource %d in track %d to read at timestamp %lf: "
-                   "entry=%" PRIu32 ", duration=%" PRIu32 ", editrate=" AVRATIONAL_FORMAT "\n",
-                   i, track->index, av_q2d(track->current_timestamp),
-                   track->resources[i].resource->base.entry_point,
-                   track->resources[i].resource->base.duration,
-                   AVRATIONAL_ARG(track->resources[i].resource->base.edit_rate));
-
-            if (track->current_resource_index != i) {
-                int ret;
-
-                av_log(s, AV_LOG_TRACE, "Switch resource on track %d: re-open context\n",
-                       track->index);
-
-                ret = open_track_resource_context(s, track, i);
-                if (ret != 0)
-                    return ret;
-                if (track->current_resource_index > 0)
-                    avformat_close_input(&track->resources[track->current_resource_index].ctx);
-                track->current_resource_index = i;
-            }
 
-            *resource = track->resources + track->current_resource_index;
-            return 0;
+    i = find_resource_for_timestamp(track, track->current_timestamp);
+    if (i < track->resource_count) {
+        av_log(s, AV_LOG_DEBUG, "Found resource %d in track %d to read at timestamp %lf: "
+               "entry=%" PRIu32 ", duration=%" PRIu32 ", editrate=" AVRATIONAL_FORMAT "\n",
+               i, track->index, av_q2d(track->current_timestamp),
+               track->resources[i].resource->base.entry_point,
+               track->resources[i].resource->base.duration,
+               AVRATIONAL_ARG(track->resources[i].resource->base.edit_rate));
+
+        if (track->current_resource_index != i) {
+            int ret;
+
+            av_log(s, AV_LOG_TRACE, "Switch resource on track %d: re-open context\n",
+                   track->index);
+
+            imf_prefetch_claim(s->priv_data, track->resources + i);
+            if (track->current_resource_index >= 0)
+                release_track_resource_context(s, track, track->current_resource_index);
+            ret = open_track_resource_context(s, track, i);
+            if (ret != 0)
+                return ret;
+            track->current_resource_index = i;
+            imf_prefetch_update(s, track, i + 1);
         }
+
+        *resource = track->resources + track->current_resource_index;
+        return 0;
     }
 
     av_log(s, AV_LOG_ERROR, "Could not find IMF track resource to read\n");
@@ -770,6 +1116,7 @@ static int imf_read_packet(AVFormatContext *s, AVPacket *pkt)
         return ret;
 
     ret = av_read_frame(resource->ctx, pkt);
+    resource->ctx_position = -1;
     if (ret)
         return ret;
 
@@ -875,6 +1222,9 @@ static int imf_close(AVFormatContext *s)
     IMFContext *c = s->priv_data;
 
     av_log(s, AV_LOG_DEBUG, "Close IMF package\n");
+#if HAVE_THREADS
+    imf_prefetch_uninit(s);
+#endif
     av_dict_free(&c->avio_opts);
     av_freep(&c->base_url);
     imf_asset_locator_map_deinit(&c->asset_locator_map);
@@ -950,6 +1300,7 @@ static int imf_seek(AVFormatContext *s, int stream_index, int64_t min_ts,
     for (i = 0; i < c->track_count; i++) {
         AVStream *st = s->streams[i];
         IMFVirtualTrackPlaybackCtx *t = c->tracks[i];
+        uint32_t first;
         int64_t dts;
 
         if (!coherent_ts(ts, av_make_q(c->cpl->edit_rate.den, c->cpl->edit_rate.num),
@@ -964,10 +1315,13 @@ static int imf_seek(AVFormatContext *s, int stream_index, int64_t min_ts,
                dts, i);
 
         t->current_timestamp = av_mul_q(av_make_q(dts, 1), st->time_base);
-        if (t->current_resource_index >= 0) {
-            avformat_close_input(&t->resources[t->current_resource_index].ctx);
-            t->current_resource_index = -1;
-        }
+        t->current_resource_index = -1;
+        first = find_resource_for_timestamp(t, t->current_timestamp);
+
+        /* keep only the demuxers of the resources around the new position,
+         * and start opening the others in the background */
+        release_track_resources_outside(s, t, first);
+        imf_prefetch_update(s, t, first);
     }
 
     return 0;
@@ -984,6 +1338,26 @@ static const AVOption imf_options[] = {
         .default_val = {.str = NULL},
         .flags       = AV_OPT_FLAG_DECODING_PARAM,
     },
+    {
+        .name        = "prefetch_resources",
+        .help        = "Number of upcoming resources of each track to open in the background.",
+        .offset      = offsetof(IMFContext, prefetch),
+        .type        = AV_OPT_TYPE_INT,
+        .default_val = {.i64 = 0},
+        .min         = 0,
+        .max         = INT_MAX,
+        .flags       = AV_OPT_FLAG_DECODING_PARAM,
+    },
+    {
+        .name        = "prefetch_threads",
+        .help        = "Maximum number of resources opened concurrently in the background.",
+        .offset      = offsetof(IMFContext, prefetch_threads),
+        .type        = AV_OPT_TYPE_INT,
+        .default_val = {.i64 = 2},
+        .min         = 1,
+        .max         = 64,
+        .flags       = AV_OPT_FLAG_DECODING_PARAM,
+    },
     {NULL},
 };
 
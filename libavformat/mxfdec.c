@@ -58,11 +58,13 @@
 #include "libavutil/timecode.h"
 #include "libavutil/opt.h"
 #include "avformat.h"
+#include "avio_internal.h"
 #include "avlanguage.h"
 #include "internal.h"
 #include "mxf.h"
 
 #define MXF_MAX_CHUNK_SIZE (32 << 20)
+#define MXF_MAX_EDIT_UNIT_OFFSETS (1 << 21)
 
 typedef enum {
     Header,
@@ -282,6 +284,9 @@ typedef struct MXFIndexTable {
     MXFIndexTableSegment **segments;    /* sorted by IndexStartPosition */
     AVIndexEntry *fake_index;   /* used for calling ff_index_search_timestamp() */
     int8_t *offsets;            /* temporal offsets for display order to stored order conversion */
+    int64_t *edit_unit_offsets; /* maps EditUnit - IndexStartPosition -> absolute file offset, built on first use */
+    int nb_edit_unit_offsets;
+    int edit_unit_offsets_init;
 } MXFIndexTable;
 
 typedef struct MXFContext {
@@ -295,6 +300,8 @@ typedef struct MXFContext {
     int essence_container_data_count;
     MXFMetadataSet **metadata_sets;
     int metadata_sets_count;
+    int *metadata_sets_hash;            /* open addressing table of metadata_sets indices + 1, keyed by instance UID */
+    unsigned metadata_sets_hash_size;   /* power of two, 0 if not allocated */
     AVFormatContext *fc;
     struct AVAES *aesc;
     uint8_t *local_tags;
@@ -309,6 +316,8 @@ typedef struct MXFContext {
     int nb_index_tables;
     MXFIndexTable *index_tables;
     int eia608_extract;
+    AVBufferPool *essence_pool;     /* packet buffers for essence larger than the AVIOContext buffer */
+    size_t essence_pool_size;
 } MXFContext;
 
 /* NOTE: klv_offset is not set (-1) for local keys */
@@ -890,18 +899,84 @@ static uint64_t partition_score(MXFPartition *p)
     return (score << 60) | ((uint64_t)p->this_partition >> 4);
 }
 
+static unsigned mxf_uid_hash(const UID uid)
+{
+    /* FNV-1a */
+    unsigned h = 2166136261U;
+    for (int i = 0; i < 16; i++)
+        h = (h ^ uid[i]) * 16777619U;
+    return h;
+}
+
+static void mxf_hash_metadata_set(MXFContext *mxf, int index)
+{
+    unsigned mask = mxf->metadata_sets_hash_size - 1;
+    unsigned h = mxf_uid_hash(mxf->metadata_sets[index]->uid) & mask;
+
+    while (mxf->metadata_sets_hash[h])
+        h = (h + 1) & mask;
+    mxf->metadata_sets_hash[h] = index + 1;
+}
+
+/* keep the load factor of the hash table at or below 1/2 */
+static int mxf_grow_metadata_sets_hash(MXFContext *mxf, int count)
+{
+    unsigned size = FFMAX(mxf->metadata_sets_hash_size, 64);
+
+    while (size < 2U * count)
+        size *= 2;
+    if (size == mxf->metadata_sets_hash_size)
+        return 0;
+
+    av_freep(&mxf->metadata_sets_hash);
+    mxf->metadata_sets_hash = av_calloc(size, sizeof(*mxf->metadata_sets_hash));
+    if (!mxf->metadata_sets_hash) {
+        mxf->metadata_sets_hash_size = 0;
+        return AVERROR(ENOMEM);
+    }
+    mxf->metadata_sets_hash_size = size;
+    for (int i = 0; i < mxf->metadata_sets_count; i++)
+        mxf_hash_metadata_set(mxf, i);
+    return 0;
+}
+
+/**
+ * Find the most recently added metadata set with the given instance UID.
+ * @param type set type to match, or AnyType
+ * @return index into mxf->metadata_sets, or -1 if none matches
+ */
+static int mxf_find_metadata_set(MXFContext *mxf, const UID uid, enum MXFMetadataSetType type)
+{
+    unsigned mask = mxf->metadata_sets_hash_size - 1;
+    int found = -1;
+
+    if (!mxf->metadata_sets_hash_size)
+        return -1;
+    /* sets sharing an instance UID are all in the same probe sequence */
+    for (unsigned h = mxf_uid_hash(uid) & mask; mxf->metadata_sets_hash[h]; h = (h + 1) & mask) {
+        int i = mxf->metadata_sets_hash[h] - 1;
+        MXFMetadataSet *set = mxf->metadata_sets[i];
+        if (i > found && !memcmp(uid, set->uid, 16) && (type == AnyType || set->type == type))
+            found = i;
+    }
+    return found;
+}
+
 static int mxf_add_metadata_set(MXFContext *mxf, MXFMetadataSet **metadata_set)
 {
     MXFMetadataSet **tmp;
     enum MXFMetadataSetType type = (*metadata_set)->type;
+    int ret;
 
     // Index Table is special because it might be added manually without
     // partition and we iterate thorugh all instances of them. Also some files
     // use the same Instance UID for different index tables...
-    if (type != IndexTableSegment) {
-        for (int i = 0; i < mxf->metadata_sets_count; i++) {
-            if (!memcmp((*metadata_set)->uid, mxf->metadata_sets[i]->uid, 16) && type == mxf->metadata_sets[i]->type) {
-                uint64_t old_s = mxf->metadata_sets[i]->partition_score;
+    if (type != IndexTableSegment && mxf->metadata_sets_hash_size) {
+        unsigned mask = mxf->metadata_sets_hash_size - 1;
+        for (unsigned h = mxf_uid_hash((*metadata_set)->uid) & mask; mxf->metadata_sets_hash[h]; h = (h + 1) & mask) {
+            MXFMetadataSet *set = mxf->metadata_sets[mxf->metadata_sets_hash[h] - 1];
+            if (!memcmp((*metadata_set)->uid, set->uid, 16) && type == set->type) {
+                uint64_t old_s = set->partition_score;
                 uint64_t new_s = (*metadata_set)->partition_score;
                 if (old_s > new_s) {
                      mxf_free_metadataset(metadata_set, 1);
@@ -910,6 +985,10 @@ static int mxf_add_metadata_set(MXFContext *mxf, MXFMetadataSet **metadata_set)
             }
         }
     }
+    if ((ret = mxf_grow_metadata_sets_hash(mxf, mxf->metadata_sets_count + 1)) < 0) {
+        mxf_free_metadataset(metadata_set, 1);
+        return ret;
+    }
     tmp = av_realloc_array(mxf->metadata_sets, mxf->metadata_sets_count + 1, sizeof(*mxf->metadata_sets));
     if (!tmp) {
         mxf_free_metadataset(metadata_set, 1);
@@ -917,6 +996,7 @@ static int mxf_add_metadata_set(MXFContext *mxf, MXFMetadataSet **metadata_set)
     }
     mxf->metadata_sets = tmp;
     mxf->metadata_sets[mxf->metadata_sets_count] = *metadata_set;
+    mxf_hash_metadata_set(mxf, mxf->metadata_sets_count);
     mxf->metadata_sets_count++;
     return 0;
 }
@@ -1532,13 +1612,8 @@ static void *mxf_resolve_strong_ref(MXFContext *mxf, UID *strong_ref, enum MXFMe
 
     if (!strong_ref)
         return NULL;
-    for (i = mxf->metadata_sets_count - 1; i >= 0; i--) {
-        if (!memcmp(*strong_ref, mxf->metadata_sets[i]->uid, 16) &&
-            (type == AnyType || mxf->metadata_sets[i]->type == type)) {
-            return mxf->metadata_sets[i];
-        }
-    }
-    return NULL;
+    i = mxf_find_metadata_set(mxf, *strong_ref, type);
+    return i >= 0 ? mxf->metadata_sets[i] : NULL;
 }
 
 static const MXFCodecUL mxf_picture_essence_container_uls[] = {
@@ -1772,7 +1847,7 @@ static int mxf_get_sorted_table_segments(MXFContext *mxf, int *nb_sorted_segment
 /**
  * Computes the absolute file offset of the given essence container offset
  */
-static int mxf_absolute_bodysid_offset(MXFContext *mxf, int body_sid, int64_t offset, int64_t *offset_out, MXFPartition **partition_out)
+static int mxf_find_bodysid_offset(MXFContext *mxf, int body_sid, int64_t offset, int64_t *offset_out, MXFPartition **partition_out)
 {
     MXFPartition *last_p = NULL;
     int a, b, m, m0;
@@ -1805,6 +1880,16 @@ static int mxf_absolute_bodysid_offset(MXFContext *mxf, int body_sid, int64_t of
         return 0;
     }
 
+    return AVERROR_INVALIDDATA;
+}
+
+static int mxf_absolute_bodysid_offset(MXFContext *mxf, int body_sid, int64_t offset, int64_t *offset_out, MXFPartition **partition_out)
+{
+    int ret = mxf_find_bodysid_offset(mxf, body_sid, offset, offset_out, partition_out);
+
+    if (ret != AVERROR_INVALIDDATA)
+        return ret;
+
     av_log(mxf->fc, AV_LOG_ERROR,
            "failed to find absolute offset of %"PRIX64" in BodySID %i - partial file?\n",
            offset, body_sid);
@@ -1832,6 +1917,64 @@ static int64_t mxf_essence_container_end(MXFContext *mxf, int body_sid)
     return 0;
 }
 
+/**
+ * Fills index_table->edit_unit_offsets with the absolute offset of every
+ * edit unit, so that packet positioning does not have to walk the segments
+ * and partitions each time. Only done for tables made of contiguous segments
+ * sharing one IndexEditRate and no longer than MXF_MAX_EDIT_UNIT_OFFSETS;
+ * the table stops at the first edit unit that cannot be mapped.
+ */
+static void mxf_compute_edit_unit_offsets(MXFContext *mxf, MXFIndexTable *index_table)
+{
+    MXFIndexTableSegment *first = index_table->segments[0];
+    int64_t nb_edit_units = 0, offset_temp = 0;
+    int64_t *offsets;
+    int n = 0;
+
+    index_table->edit_unit_offsets_init = 1;
+
+    for (int i = 0; i < index_table->nb_segments; i++) {
+        MXFIndexTableSegment *s = index_table->segments[i];
+
+        if (s->index_start_position != first->index_start_position + nb_edit_units ||
+            s->index_duration > MXF_MAX_EDIT_UNIT_OFFSETS - nb_edit_units ||
+            av_cmp_q(s->index_edit_rate, first->index_edit_rate))
+            return;
+        nb_edit_units += s->index_duration;
+    }
+
+    if (!nb_edit_units || !(offsets = av_malloc_array(nb_edit_units, sizeof(*offsets))))
+        return;
+
+    for (int i = 0; i < index_table->nb_segments; i++) {
+        MXFIndexTableSegment *s = index_table->segments[i];
+        int avid = s->nb_index_entries == 2 * s->index_duration + 1;
+
+        for (int64_t index = 0; index < s->index_duration; index++, n++) {
+            int64_t pos;
+
+            if (s->edit_unit_byte_count)
+                pos = offset_temp + s->edit_unit_byte_count * index;
+            else if ((index << avid) < s->nb_index_entries)
+                pos = s->stream_offset_entries[index << avid];
+            else
+                goto end;
+
+            if (mxf_find_bodysid_offset(mxf, index_table->body_sid, pos, &offsets[n], NULL) < 0)
+                goto end;
+        }
+        offset_temp += s->edit_unit_byte_count * s->index_duration;
+    }
+
+end:
+    if (!n) {
+        av_free(offsets);
+        return;
+    }
+    index_table->edit_unit_offsets    = offsets;
+    index_table->nb_edit_unit_offsets = n;
+}
+
 /* EditUnit -> absolute offset */
 static int mxf_edit_unit_absolute_offset(MXFContext *mxf, MXFIndexTable *index_table, int64_t edit_unit, AVRational edit_rate, int64_t *edit_unit_out, int64_t *offset_out, MXFPartition **partition_out, int nag)
 {
@@ -1840,6 +1983,21 @@ static int mxf_edit_unit_absolute_offset(MXFContext *mxf, MXFIndexTable *index_t
 
     edit_unit = av_rescale_q(edit_unit, index_table->segments[0]->index_edit_rate, edit_rate);
 
+    if (!index_table->edit_unit_offsets_init)
+        mxf_compute_edit_unit_offsets(mxf, index_table);
+
+    if (index_table->edit_unit_offsets && !partition_out) {
+        MXFIndexTableSegment *first = index_table->segments[0];
+        int64_t index = FFMAX(edit_unit, first->index_start_position) - first->index_start_position;
+
+        if (index < index_table->nb_edit_unit_offsets) {
+            if (edit_unit_out)
+                *edit_unit_out = av_rescale_q(index + first->index_start_position, edit_rate, first->index_edit_rate);
+            *offset_out = index_table->edit_unit_offsets[index];
+            return 0;
+        }
+    }
+
     for (i = 0; i < index_table->nb_segments; i++) {
         MXFIndexTableSegment *s = index_table->segments[i];
 
@@ -3781,6 +3939,25 @@ static int mxf_get_next_track_edit_unit(MXFContext *mxf, MXFTrack *track, int64_
     a = -1;
     b = track->original_duration;
 
+    /* with a single CBE segment the edit unit follows from the byte count,
+     * narrow the search to it if both neighbours confirm the guess */
+    if (t->nb_segments == 1 && t->segments[0]->edit_unit_byte_count &&
+        !av_cmp_q(t->segments[0]->index_edit_rate, track->edit_rate) &&
+        mxf_edit_unit_absolute_offset(mxf, t, 0, track->edit_rate, NULL, &offset, NULL, 0) >= 0) {
+        int64_t edit_unit_byte_count = t->segments[0]->edit_unit_byte_count;
+
+        m = current_offset > offset ? (current_offset - offset + edit_unit_byte_count - 1) / edit_unit_byte_count : 0;
+        m = FFMIN(m, b);
+        if (m > 0 &&
+            mxf_edit_unit_absolute_offset(mxf, t, m - 1, track->edit_rate, NULL, &offset, NULL, 0) >= 0 &&
+            offset < current_offset)
+            a = m - 1;
+        if (m < b &&
+            mxf_edit_unit_absolute_offset(mxf, t, m, track->edit_rate, NULL, &offset, NULL, 0) >= 0 &&
+            offset >= current_offset)
+            b = m;
+    }
+
     while (b - a > 1) {
         m = (a + b) >> 1;
         if (mxf_edit_unit_absolute_offset(mxf, t, m, track->edit_rate, NULL, &offset, NULL, 0) < 0)
@@ -3917,6 +4094,53 @@ static int mxf_set_pts(MXFContext *mxf, AVStream *st, AVPacket *pkt)
     return 0;
 }
 
+/**
+ * Read essence into a packet. Payloads larger than the AVIOContext buffer
+ * are read directly into a buffer from a pool sized for the largest edit
+ * unit seen so far, which saves reallocating and faulting in the pages of
+ * a multi-megabyte packet for every frame.
+ */
+static int mxf_get_essence_packet(AVFormatContext *s, AVPacket *pkt, int64_t length)
+{
+    MXFContext *mxf = s->priv_data;
+    int64_t pos = avio_tell(s->pb);
+    int size, ret;
+
+    if (length <= s->pb->buffer_size || length > INT_MAX - AV_INPUT_BUFFER_PADDING_SIZE)
+        return av_get_packet(s->pb, pkt, length);
+
+    size = ffio_limit(s->pb, length);
+    if (size <= s->pb->buffer_size)
+        return av_get_packet(s->pb, pkt, size);
+
+    if (!mxf->essence_pool || mxf->essence_pool_size < size + AV_INPUT_BUFFER_PADDING_SIZE) {
+        av_buffer_pool_uninit(&mxf->essence_pool);
+        mxf->essence_pool_size = FFALIGN((size_t)size + AV_INPUT_BUFFER_PADDING_SIZE, 1 << 20);
+        mxf->essence_pool = av_buffer_pool_init(mxf->essence_pool_size, NULL);
+        if (!mxf->essence_pool)
+            return AVERROR(ENOMEM);
+    }
+
+    av_packet_unref(pkt);
+    pkt->buf = av_buffer_pool_get(mxf->essence_pool);
+    if (!pkt->buf)
+        return AVERROR(ENOMEM);
+    pkt->data = pkt->buf->data;
+    pkt->pos  = pos;
+
+    ret = avio_read(s->pb, pkt->data, size);
+    if (ret <= 0) {
+        av_packet_unref(pkt);
+        return ret;
+    }
+    pkt->size = ret;
+    memset(pkt->data + ret, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    if (ret < length)
+        pkt->flags |= AV_PKT_FLAG_CORRUPT;
+
+    return ret;
+}
+
 static int mxf_read_packet(AVFormatContext *s, AVPacket *pkt)
 {
     KLVPacket klv;
@@ -4016,7 +4240,7 @@ static int mxf_read_packet(AVFormatContext *s, AVPacket *pkt)
                     return ret;
                 }
             } else {
-                ret = av_get_packet(s->pb, pkt, klv.length);
+                ret = mxf_get_essence_packet(s, pkt, klv.length);
                 if (ret < 0) {
                     mxf->current_klv_data = (KLVPacket){{0}};
                     return ret;
@@ -4061,6 +4285,8 @@ static int mxf_read_close(AVFormatContext *s)
     mxf->metadata_sets_count = 0;
     av_freep(&mxf->partitions);
     av_freep(&mxf->metadata_sets);
+    av_freep(&mxf->metadata_sets_hash);
+    mxf->metadata_sets_hash_size = 0;
     av_freep(&mxf->aesc);
     av_freep(&mxf->local_tags);
 
@@ -4070,9 +4296,11 @@ static int mxf_read_close(AVFormatContext *s)
             av_freep(&mxf->index_tables[i].ptses);
             av_freep(&mxf->index_tables[i].fake_index);
             av_freep(&mxf->index_tables[i].offsets);
+            av_freep(&mxf->index_tables[i].edit_unit_offsets);
         }
     }
     av_freep(&mxf->index_tables);
+    av_buffer_pool_uninit(&mxf->essence_pool);
 
     return 0;
 }
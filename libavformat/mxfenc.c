@@ -93,6 +93,7 @@ typedef struct MXFStreamContext {
     int video_bit_rate;
     int slice_offset;
     int frame_size;          ///< frame size in bytes
+    int padded_size;         ///< size of the essence element including fill, if frames are padded to frame_size
     int seq_closed_gop;      ///< all gops in sequence are closed, used in mpeg-2 descriptor
     int max_gop;             ///< maximum gop size, used by mpeg-2 descriptor
     int b_picture_count;     ///< maximum number of consecutive b pictures, used in mpeg-2 descriptor
@@ -397,6 +398,7 @@ typedef struct MXFContext {
     AVRational time_base;
     int header_written;
     MXFIndexEntry *index_entries;
+    unsigned int index_entries_size; ///< allocated size of index_entries, in bytes
     unsigned edit_units_count;
     uint64_t timestamp;   ///< timestamp, as year(16),month(8),day(8),hour(8),minutes(8),msec/4(8)
     uint8_t slice_count;  ///< index slice count minus 1 (1 if no audio, 0 otherwise)
@@ -404,6 +406,8 @@ typedef struct MXFContext {
     uint64_t *body_partition_offset;
     unsigned body_partitions_count;
     int last_key_index;  ///< index of last key frame
+    int *gop_pictures;   ///< index entry of each picture of the current GOP, in display order
+    unsigned int gop_pictures_size;
     uint64_t duration;
     AVTimecode tc;       ///< timecode context
     AVStream *timecode_track;
@@ -420,6 +424,7 @@ typedef struct MXFContext {
     int store_user_comments;
     int track_instance_count; // used to generate MXFTrack uuids
     int cbr_index;           ///< use a constant bitrate index
+    int j2k_frame_size;      ///< size JPEG 2000 frames are padded to, 0 to index them individually
     uint8_t unused_tags[MXF_NUM_TAGS];  ///< local tags that we know will not be used
     MXFStreamContext timecode_track_priv;
 } MXFContext;
@@ -1738,12 +1743,40 @@ static unsigned klv_fill_size(uint64_t size)
         return pad & (KAG_SIZE-1);
 }
 
+/**
+ * Map the pictures of the GOP starting at key_index from display order to
+ * index entries, so that temporal offsets are found without searching.
+ * @return end of the GOP, or key_index if the map could not be allocated
+ */
+static int mxf_index_gop(MXFContext *mxf, int key_index)
+{
+    int end = key_index + 1;
+
+    while (end < mxf->edit_units_count && (mxf->index_entries[end].flags & 0x33))
+        end++;
+
+    av_fast_malloc(&mxf->gop_pictures, &mxf->gop_pictures_size,
+                   (end - key_index) * sizeof(*mxf->gop_pictures));
+    if (!mxf->gop_pictures)
+        return key_index;
+
+    for (int j = 0; j < end - key_index; j++)
+        mxf->gop_pictures[j] = -1;
+    // first match wins, as with a forward search
+    for (int j = end - 1; j >= key_index; j--)
+        if (mxf->index_entries[j].temporal_ref < end - key_index)
+            mxf->gop_pictures[mxf->index_entries[j].temporal_ref] = j;
+
+    return end;
+}
+
 static void mxf_write_index_table_segment(AVFormatContext *s)
 {
     MXFContext *mxf = s->priv_data;
     AVIOContext *pb = s->pb;
     int i, j, temporal_reordering = 0;
     int key_index = mxf->last_key_index;
+    int gop_end = key_index;
     int prev_non_b_picture = 0;
     int audio_frame_size = 0;
     int64_t pos;
@@ -1838,14 +1871,19 @@ static void mxf_write_index_table_segment(AVFormatContext *s)
                 sc->max_gop = FFMAX(sc->max_gop, i - mxf->last_key_index);
                 mxf->last_key_index = key_index;
                 key_index = i;
+                gop_end = temporal_reordering ? mxf_index_gop(mxf, key_index) : key_index;
             }
 
             if (temporal_reordering) {
                 int pic_num_in_gop = i - key_index;
                 if (pic_num_in_gop != mxf->index_entries[i].temporal_ref) {
-                    for (j = key_index; j < mxf->edit_units_count; j++) {
-                        if (pic_num_in_gop == mxf->index_entries[j].temporal_ref)
-                            break;
+                    j = i < gop_end ? mxf->gop_pictures[pic_num_in_gop] : -1;
+                    if (j < 0) {
+                        // not in this GOP, look further
+                        for (j = FFMAX(gop_end, key_index); j < mxf->edit_units_count; j++) {
+                            if (pic_num_in_gop == mxf->index_entries[j].temporal_ref)
+                                break;
+                        }
                     }
                     if (j == mxf->edit_units_count)
                         av_log(s, AV_LOG_WARNING, "missing frames\n");
@@ -1884,14 +1922,20 @@ static void mxf_write_index_table_segment(AVFormatContext *s)
     mxf_update_klv_size(pb, pos);
 }
 
+static void mxf_write_fill_item(AVIOContext *pb, unsigned size)
+{
+    av_assert1(size >= 16 + 4);
+    avio_write(pb, klv_fill_key, 16);
+    size -= 16 + 4;
+    klv_encode_ber4_length(pb, size);
+    ffio_fill(pb, 0, size);
+}
+
 static void mxf_write_klv_fill(AVFormatContext *s)
 {
     unsigned pad = klv_fill_size(avio_tell(s->pb));
     if (pad) {
-        avio_write(s->pb, klv_fill_key, 16);
-        pad -= 16 + 4;
-        klv_encode_ber4_length(s->pb, pad);
-        ffio_fill(s->pb, 0, pad);
+        mxf_write_fill_item(s->pb, pad);
         av_assert1(!(avio_tell(s->pb) & (KAG_SIZE-1)));
     }
 }
@@ -2499,7 +2543,7 @@ static int mxf_init_timecode(AVFormatContext *s, AVStream *st, AVRational tbc)
 static int mxf_init(AVFormatContext *s)
 {
     MXFContext *mxf = s->priv_data;
-    int i, ret;
+    int i, ret, padded = 0;
     uint8_t present[FF_ARRAY_ELEMS(mxf_essence_container_uls)] = {0};
     int64_t timestamp = 0;
 
@@ -2568,6 +2612,13 @@ static int mxf_init(AVFormatContext *s)
                 st->codecpar->codec_id == AV_CODEC_ID_DVVIDEO)
                 mxf->cbr_index = 1;
 
+            if (mxf->j2k_frame_size && st->codecpar->codec_id == AV_CODEC_ID_JPEG2000) {
+                mxf->cbr_index = 1;
+                sc->frame_size = mxf->j2k_frame_size;
+                sc->padded_size = 1; // set once the edit unit layout is known
+                padded = 1;
+            }
+
             if (s->oformat == &ff_mxf_d10_muxer) {
                 int ntsc = mxf->time_base.den != 25;
                 int ul_index;
@@ -2690,6 +2741,20 @@ static int mxf_init(AVFormatContext *s)
         present[sc->index]++;
     }
 
+    if (padded) {
+        // the edit units only have a constant size if all their elements do
+        for (i = 0; i < s->nb_streams; i++) {
+            AVCodecParameters *par = s->streams[i]->codecpar;
+            if ((par->codec_type == AVMEDIA_TYPE_AUDIO &&
+                 (int64_t)par->sample_rate * mxf->time_base.num % mxf->time_base.den) ||
+                par->codec_type == AVMEDIA_TYPE_DATA) {
+                av_log(s, AV_LOG_ERROR, "track %d: element size varies between edit units, "
+                       "j2k_frame_size cannot be used\n", i);
+                return AVERROR(EINVAL);
+            }
+        }
+    }
+
     if (s->oformat == &ff_mxf_d10_muxer || s->oformat == &ff_mxf_opatom_muxer) {
         mxf->essence_container_count = 1;
     }
@@ -2871,7 +2936,11 @@ static void mxf_compute_edit_unit_byte_count(AVFormatContext *s)
         MXFStreamContext *sc = st->priv_data;
         sc->slice_offset = mxf->edit_unit_byte_count;
         mxf->edit_unit_byte_count += 16 + 4 + sc->frame_size;
+        if (sc->padded_size) // room for a fill item after frames shorter than frame_size
+            mxf->edit_unit_byte_count += 16 + 4;
         mxf->edit_unit_byte_count += klv_fill_size(mxf->edit_unit_byte_count);
+        if (sc->padded_size)
+            sc->padded_size = mxf->edit_unit_byte_count - sc->slice_offset;
     }
 }
 
@@ -2891,13 +2960,18 @@ static int mxf_write_packet(AVFormatContext *s, AVPacket *pkt)
         return AVERROR_INVALIDDATA;
     }
 
-    if (!mxf->cbr_index && !mxf->edit_unit_byte_count && !(mxf->edit_units_count % EDIT_UNITS_PER_BODY)) {
-        if ((err = av_reallocp_array(&mxf->index_entries, mxf->edit_units_count
-                                     + EDIT_UNITS_PER_BODY, sizeof(*mxf->index_entries))) < 0) {
-            mxf->edit_units_count = 0;
+    if (!mxf->cbr_index && !mxf->edit_unit_byte_count) {
+        // entries are dropped once written to an index table segment,
+        // so the buffer only grows up to the largest segment
+        void *tmp = NULL;
+        if (mxf->edit_units_count < INT_MAX / sizeof(*mxf->index_entries))
+            tmp = av_fast_realloc(mxf->index_entries, &mxf->index_entries_size,
+                                  (mxf->edit_units_count + 1) * sizeof(*mxf->index_entries));
+        if (!tmp) {
             av_log(s, AV_LOG_ERROR, "could not allocate index entries\n");
-            return err;
+            return AVERROR(ENOMEM);
         }
+        mxf->index_entries = tmp;
     }
 
     if (st->codecpar->codec_id == AV_CODEC_ID_MPEG2VIDEO) {
@@ -2928,7 +3002,12 @@ static int mxf_write_packet(AVFormatContext *s, AVPacket *pkt)
     }
 
     if (mxf->cbr_index) {
-        if (pkt->size != sc->frame_size && st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+        if (sc->padded_size && pkt->size > sc->frame_size) {
+            av_log(s, AV_LOG_ERROR, "track %d: frame size %d exceeds j2k_frame_size %d\n",
+                   st->index, pkt->size, sc->frame_size);
+            return AVERROR(EINVAL);
+        }
+        if (!sc->padded_size && pkt->size != sc->frame_size && st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
             av_log(s, AV_LOG_ERROR, "track %d: frame size does not match index unit size, %d != %d\n",
                    st->index, pkt->size, sc->frame_size);
             return -1;
@@ -2988,6 +3067,12 @@ static int mxf_write_packet(AVFormatContext *s, AVPacket *pkt)
     if (s->oformat == &ff_mxf_d10_muxer &&
         st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
         mxf_write_d10_audio_packet(s, st, pkt);
+    } else if (sc->padded_size) {
+        klv_encode_ber4_length(pb, pkt->size);
+        avio_write(pb, pkt->data, pkt->size);
+        // fill up to the constant element size, the next element stays KAG aligned
+        mxf_write_fill_item(pb, sc->padded_size - (16 + 4 + pkt->size));
+        mxf->body_offset += sc->padded_size;
     } else {
         klv_encode_ber4_length(pb, pkt->size); // write length
         avio_write(pb, pkt->data, pkt->size);
@@ -3086,6 +3171,7 @@ static void mxf_deinit(AVFormatContext *s)
     MXFContext *mxf = s->priv_data;
 
     av_freep(&mxf->index_entries);
+    av_freep(&mxf->gop_pictures);
     av_freep(&mxf->body_partition_offset);
     av_freep(&mxf->timecode_track);
 }
@@ -3188,6 +3274,8 @@ static const AVOption mxf_options[] = {
     MXF_COMMON_OPTIONS
     { "store_user_comments", "",
       offsetof(MXFContext, store_user_comments), AV_OPT_TYPE_BOOL, {.i64 = 1}, 0, 1, AV_OPT_FLAG_ENCODING_PARAM},
+    { "j2k_frame_size", "Pad JPEG 2000 frames to this size and write a constant bytes per edit unit index",
+      offsetof(MXFContext, j2k_frame_size), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX / 2, AV_OPT_FLAG_ENCODING_PARAM},
     { NULL },
 };
 
@@ -284,20 +284,62 @@ const char *asset_map_doc =
     "</am:AssetList>"
     "</am:AssetMap>";
 
+typedef struct MemoryReader {
+    const char *data;
+    size_t size;
+    size_t pos;
+} MemoryReader;
+
+static int read_memory(void *opaque, uint8_t *buf, int buf_size)
+{
+    MemoryReader *mr = opaque;
+
+    buf_size = FFMIN(buf_size, mr->size - mr->pos);
+    if (!buf_size)
+        return AVERROR_EOF;
+    memcpy(buf, mr->data + mr->pos, buf_size);
+    mr->pos += buf_size;
+
+    return buf_size;
+}
+
+static AVIOContext *open_memory(MemoryReader *mr, const char *doc)
+{
+    uint8_t *buf = av_malloc(4096);
+    AVIOContext *pb;
+
+    if (!buf)
+        return NULL;
+    mr->data = doc;
+    mr->size = strlen(doc);
+    mr->pos  = 0;
+    pb = avio_alloc_context(buf, 4096, 0, mr, read_memory, NULL, NULL);
+    if (!pb)
+        av_free(buf);
+    return pb;
+}
+
+static void close_memory(AVIOContext **pb)
+{
+    if (*pb)
+        av_freep(&(*pb)->buffer);
+    avio_context_free(pb);
+}
+
 static int test_cpl_parsing(void)
 {
-    xmlDocPtr doc;
+    MemoryReader mr;
+    AVIOContext *pb;
     FFIMFCPL *cpl;
     int ret;
 
-    doc = xmlReadMemory(cpl_doc, strlen(cpl_doc), NULL, NULL, 0);
-    if (doc == NULL) {
+    if (!(pb = open_memory(&mr, cpl_doc))) {
         printf("XML parsing failed.\n");
         return 1;
     }
 
-    ret = ff_imf_parse_cpl_from_xml_dom(doc, &cpl);
-    xmlFreeDoc(doc);
+    ret = ff_imf_parse_cpl(pb, &cpl);
+    close_memory(&pb);
     if (ret) {
         printf("CPL parsing failed.\n");
         return 1;
@@ -340,18 +382,18 @@ static int test_cpl_parsing(void)
 
 static int test_bad_cpl_parsing(void)
 {
-    xmlDocPtr doc;
+    MemoryReader mr;
+    AVIOContext *pb;
     FFIMFCPL *cpl;
     int ret;
 
-    doc = xmlReadMemory(cpl_bad_doc, strlen(cpl_bad_doc), NULL, NULL, 0);
-    if (doc == NULL) {
+    if (!(pb = open_memory(&mr, cpl_bad_doc))) {
         printf("XML parsing failed.\n");
         return 1;
     }
 
-    ret = ff_imf_parse_cpl_from_xml_dom(doc, &cpl);
-    xmlFreeDoc(doc);
+    ret = ff_imf_parse_cpl(pb, &cpl);
+    close_memory(&pb);
     if (ret) {
         printf("CPL parsing failed.\n");
         return ret;
@@ -403,12 +445,15 @@ static IMFAssetLocator ASSET_MAP_EXPECTED_LOCATORS[5] = {
 static int test_asset_map_parsing(void)
 {
     IMFAssetLocatorMap asset_locator_map;
-    xmlDoc *doc;
+    xmlTextReaderPtr reader;
+    MemoryReader mr;
+    AVIOContext *pb;
     int ret;
 
-    doc = xmlReadMemory(asset_map_doc, strlen(asset_map_doc), NULL, NULL, 0);
-    if (doc == NULL) {
+    if (!(pb = open_memory(&mr, asset_map_doc)) ||
+        !(reader = ff_imf_xml_reader_alloc(pb, NULL))) {
         printf("Asset map XML parsing failed.\n");
+        close_memory(&pb);
         return 1;
     }
 
@@ -416,7 +461,7 @@ static int test_asset_map_parsing(void)
     imf_asset_locator_map_init(&asset_locator_map);
 
     printf("Parse asset map XML document\n");
-    ret = parse_imf_asset_map_from_xml_dom(NULL, doc, &asset_locator_map, doc->name);
+    ret = parse_imf_asset_map_from_xml_reader(NULL, reader, &asset_locator_map, NULL);
     if (ret) {
         printf("Asset map parsing failed.\n");
         goto cleanup;
@@ -440,7 +485,8 @@ static int test_asset_map_parsing(void)
 
 cleanup:
     imf_asset_locator_map_deinit(&asset_locator_map);
-    xmlFreeDoc(doc);
+    xmlFreeTextReader(reader);
+    close_memory(&pb);
     return ret;
 }
 
@@ -504,6 +550,97 @@ fail:
     return 1;
 }
 
+static int count_open_resources(IMFVirtualTrackPlaybackCtx *track)
+{
+    int count = 0;
+
+    for (uint32_t i = 0; i < track->resource_count; i++)
+        count += !!track->resources[i].ctx;
+
+    return count;
+}
+
+/* make resource the current one, as imf_read_packet() would when reaching it */
+static int play_resource(AVFormatContext *s, IMFVirtualTrackPlaybackCtx *track, int32_t index)
+{
+    if (track->current_resource_index >= 0)
+        release_track_resource_context(s, track, track->current_resource_index);
+    track->current_resource_index = index;
+    if (!track->resources[index].ctx && !(track->resources[index].ctx = avformat_alloc_context()))
+        return AVERROR(ENOMEM);
+
+    return 0;
+}
+
+static int test_seek_release(void)
+{
+    char uri_a[] = "a.mxf", uri_b[] = "b.mxf";
+    IMFAssetLocator locators[2] = { { .absolute_uri = uri_a }, { .absolute_uri = uri_b } };
+    IMFVirtualTrackResourcePlaybackCtx resources[4] = { 0 };
+    IMFVirtualTrackPlaybackCtx track = { 0 };
+    IMFVirtualTrackPlaybackCtx *tracks[1] = { &track };
+    FFIMFCPL cpl = { .edit_rate = { 24, 1 } };
+    IMFContext c = { .cpl = &cpl, .track_count = 1, .tracks = tracks };
+    AVFormatContext *s;
+    AVStream *st;
+    int ret = 1;
+
+    if (!(s = avformat_alloc_context()))
+        return 1;
+    if (!(st = avformat_new_stream(s, NULL)))
+        goto cleanup;
+    st->time_base = av_make_q(1, 24);
+    s->priv_data = &c;
+
+    /* the resources alternate between two track files */
+    for (int i = 0; i < 4; i++) {
+        resources[i].locator = &locators[i & 1];
+        resources[i].ctx_position = -1;
+        resources[i].start_time = av_make_q(i, 1);
+        resources[i].end_time = av_make_q(i + 1, 1);
+        resources[i].ts_offset = av_make_q(i, 1);
+    }
+    track.resources = resources;
+    track.resource_count = 4;
+    track.current_resource_index = -1;
+
+    for (c.prefetch = 0; c.prefetch <= 2; c.prefetch++) {
+        printf("Seek across resources sharing track files, prefetch %d\n", c.prefetch);
+
+        if (play_resource(s, &track, 0) < 0 || play_resource(s, &track, 1) < 0)
+            goto cleanup;
+        printf("Open resources before seeking back: %d\n", count_open_resources(&track));
+        if (imf_seek(s, 0, 0, 0, 0, 0) < 0)
+            goto cleanup;
+        printf("Open resources after seeking back: %d\n", count_open_resources(&track));
+
+        if (play_resource(s, &track, 0) < 0 || play_resource(s, &track, 1) < 0 ||
+            play_resource(s, &track, 2) < 0)
+            goto cleanup;
+        printf("Open resources before seeking forward: %d\n", count_open_resources(&track));
+        if (imf_seek(s, 0, 72, 72, 72, 0) < 0)
+            goto cleanup;
+        printf("Open resources after seeking forward: %d\n", count_open_resources(&track));
+
+        if (play_resource(s, &track, 3) < 0 || imf_seek(s, 0, 24, 24, 24, 0) < 0)
+            goto cleanup;
+        printf("Open resources after seeking back: %d\n", count_open_resources(&track));
+        if (imf_seek(s, 0, 0, 0, 0, 0) < 0)
+            goto cleanup;
+        printf("Open resources after seeking to the start: %d\n", count_open_resources(&track));
+    }
+
+    ret = 0;
+
+cleanup:
+    for (int i = 0; i < 4; i++)
+        avformat_close_input(&resources[i].ctx);
+    if (s)
+        s->priv_data = NULL;
+    avformat_free_context(s);
+    return ret;
+}
+
 int main(int argc, char *argv[])
 {
     int ret = 0;
@@ -517,6 +654,9 @@ int main(int argc, char *argv[])
     if (test_path_type_functions() != 0)
         ret = 1;
 
+    if (test_seek_release() != 0)
+        ret = 1;
+
     printf("#### The following should fail ####\n");
     if (test_bad_cpl_parsing() == 0)
         ret = 1;
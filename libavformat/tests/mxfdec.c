@@ -0,0 +1,117 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavformat/mxfdec.c"
+
+#include <stdio.h>
+
+#include "libavutil/lfg.h"
+#include "libavutil/time.h"
+
+#define NB_SETS 50000
+
+static const enum MXFMetadataSetType set_types[] = {
+    SourceClip, TimecodeComponent, Sequence, EssenceContainerData,
+};
+
+/* reference lookup: the most recently added set wins */
+static MXFMetadataSet *resolve_linear(MXFContext *mxf, const UID uid, enum MXFMetadataSetType type)
+{
+    for (int i = mxf->metadata_sets_count - 1; i >= 0; i--)
+        if (!memcmp(uid, mxf->metadata_sets[i]->uid, 16) &&
+            (type == AnyType || mxf->metadata_sets[i]->type == type))
+            return mxf->metadata_sets[i];
+    return NULL;
+}
+
+static int test_metadata_sets(void)
+{
+    MXFContext mxf = { 0 };
+    UID *uids = av_malloc_array(NB_SETS, sizeof(*uids));
+    AVLFG lfg;
+    int64_t t0, t1;
+    int ret = 0, resolved = 0, mismatches = 0;
+
+    if (!uids)
+        return AVERROR(ENOMEM);
+    av_lfg_init(&lfg, 0xdeadbeef);
+
+    t0 = av_gettime_relative();
+    for (int i = 0; i < NB_SETS; i++) {
+        enum MXFMetadataSetType type = set_types[i % FF_ARRAY_ELEMS(set_types)];
+        MXFMetadataSet *set = av_mallocz(type == Sequence ? sizeof(MXFSequence) : sizeof(MXFStructuralComponent));
+
+        if (!set) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        set->type = type;
+        set->partition_score = i;
+        if (i % 10 == 9) {
+            /* set repeated in another partition, dropped if that one scores lower */
+            memcpy(uids[i], uids[i - 8], 16);
+            if (i % 20 == 19)
+                set->partition_score = 0;
+        } else if (i % 10 == 5) {
+            /* Instance UID shared by sets of different types */
+            memcpy(uids[i], uids[i - 3], 16);
+        } else {
+            for (int j = 0; j < 16; j += 4)
+                AV_WN32(uids[i] + j, av_lfg_get(&lfg));
+        }
+        memcpy(set->uid, uids[i], 16);
+        if ((ret = mxf_add_metadata_set(&mxf, &set)) < 0)
+            goto end;
+    }
+
+    t1 = av_gettime_relative();
+    for (int i = 0; i < NB_SETS; i++) {
+        enum MXFMetadataSetType type = set_types[i % FF_ARRAY_ELEMS(set_types)];
+        resolved += !!mxf_resolve_strong_ref(&mxf, &uids[i], type);
+        resolved += !!mxf_resolve_strong_ref(&mxf, &uids[i], AnyType);
+    }
+    fprintf(stderr, "added %d sets in %"PRId64" us, resolved %d references in %"PRId64" us\n",
+            NB_SETS, t1 - t0, 2 * NB_SETS, av_gettime_relative() - t1);
+
+    for (int i = 0; i < NB_SETS; i++) {
+        enum MXFMetadataSetType type = set_types[i % FF_ARRAY_ELEMS(set_types)];
+        if (i % 100 == 0 || i % 10 == 9 || i % 10 == 5) {
+            mismatches += mxf_resolve_strong_ref(&mxf, &uids[i], type)    != resolve_linear(&mxf, uids[i], type);
+            mismatches += mxf_resolve_strong_ref(&mxf, &uids[i], AnyType) != resolve_linear(&mxf, uids[i], AnyType);
+        }
+    }
+
+    printf("metadata sets: %d of %d\n", mxf.metadata_sets_count, NB_SETS);
+    printf("resolved: %d of %d\n", resolved, 2 * NB_SETS);
+    printf("mismatches: %d\n", mismatches);
+
+end:
+    for (int i = 0; i < mxf.metadata_sets_count; i++)
+        mxf_free_metadataset(mxf.metadata_sets + i, 1);
+    av_freep(&mxf.metadata_sets);
+    av_freep(&mxf.metadata_sets_hash);
+    av_free(uids);
+    return ret;
+}
+
+int main(void)
+{
+    if (test_metadata_sets() < 0)
+        return 1;
+    return 0;
+}
@@ -234,6 +234,100 @@ rgb48funcs(rgb, BE, AV_PIX_FMT_RGB48BE)
 rgb48funcs(bgr, LE, AV_PIX_FMT_BGR48LE)
 rgb48funcs(bgr, BE, AV_PIX_FMT_BGR48BE)
 
+/* XYZ12 input is read by passing the context in place of the palette */
+static av_always_inline void xyz12ToRgb48_pixel(const SwsContext *c, const uint16_t *src,
+                                               int be, int *r, int *g, int *b)
+{
+    const int16_t (*mat)[4] = c->xyz2rgb_matrix;
+    int x, y, z;
+
+    x = c->xyzgamma[(be ? AV_RB16(src + 0) : AV_RL16(src + 0)) >> 4];
+    y = c->xyzgamma[(be ? AV_RB16(src + 1) : AV_RL16(src + 1)) >> 4];
+    z = c->xyzgamma[(be ? AV_RB16(src + 2) : AV_RL16(src + 2)) >> 4];
+
+    // same as xyz12Torgb48() followed by reading back the RGB48 pixel
+    *r = c->rgbgamma[av_clip_uintp2(mat[0][0] * x + mat[0][1] * y + mat[0][2] * z >> 12, 12)] << 4;
+    *g = c->rgbgamma[av_clip_uintp2(mat[1][0] * x + mat[1][1] * y + mat[1][2] * z >> 12, 12)] << 4;
+    *b = c->rgbgamma[av_clip_uintp2(mat[2][0] * x + mat[2][1] * y + mat[2][2] * z >> 12, 12)] << 4;
+}
+
+static av_always_inline void xyz12ToY_c_template(uint16_t *dst, const uint16_t *src,
+                                                int width, const SwsContext *c, int be)
+{
+    const int32_t *rgb2yuv = c->input_rgb2yuv_table;
+    int32_t ry = rgb2yuv[RY_IDX], gy = rgb2yuv[GY_IDX], by = rgb2yuv[BY_IDX];
+
+    for (int i = 0; i < width; i++) {
+        int r, g, b;
+
+        xyz12ToRgb48_pixel(c, src + 3 * i, be, &r, &g, &b);
+        dst[i] = (ry*(unsigned)r + gy*(unsigned)g + by*(unsigned)b +
+                  (0x2001 << (RGB2YUV_SHIFT - 1))) >> RGB2YUV_SHIFT;
+    }
+}
+
+static av_always_inline void xyz12ToUV_c_template(uint16_t *dstU, uint16_t *dstV,
+                                                 const uint16_t *src, int width,
+                                                 const SwsContext *c, int be, int half)
+{
+    const int32_t *rgb2yuv = c->input_rgb2yuv_table;
+    int32_t ru = rgb2yuv[RU_IDX], gu = rgb2yuv[GU_IDX], bu = rgb2yuv[BU_IDX];
+    int32_t rv = rgb2yuv[RV_IDX], gv = rgb2yuv[GV_IDX], bv = rgb2yuv[BV_IDX];
+
+    for (int i = 0; i < width; i++) {
+        int r, g, b;
+
+        if (half) {
+            int r1, g1, b1;
+
+            xyz12ToRgb48_pixel(c, src + 6 * i,     be, &r,  &g,  &b);
+            xyz12ToRgb48_pixel(c, src + 6 * i + 3, be, &r1, &g1, &b1);
+            r = (r + r1 + 1) >> 1;
+            g = (g + g1 + 1) >> 1;
+            b = (b + b1 + 1) >> 1;
+        } else {
+            xyz12ToRgb48_pixel(c, src + 3 * i, be, &r, &g, &b);
+        }
+
+        dstU[i] = (ru*r + gu*g + bu*b + (0x10001 << (RGB2YUV_SHIFT - 1))) >> RGB2YUV_SHIFT;
+        dstV[i] = (rv*r + gv*g + bv*b + (0x10001 << (RGB2YUV_SHIFT - 1))) >> RGB2YUV_SHIFT;
+    }
+}
+
+#define xyz12funcs(BE_LE, be)                                                  \
+static void xyz12 ## BE_LE ## ToY_c(uint8_t *dst, const uint8_t *src,         \
+                                    const uint8_t *unused0, const uint8_t *unused1, \
+                                    int width, uint32_t *opaque)               \
+{                                                                              \
+    xyz12ToY_c_template((uint16_t *)dst, (const uint16_t *)src, width,         \
+                        (const SwsContext *)opaque, be);                       \
+}                                                                              \
+                                                                               \
+static void xyz12 ## BE_LE ## ToUV_c(uint8_t *dstU, uint8_t *dstV,            \
+                                     const uint8_t *unused0, const uint8_t *src1, \
+                                     const uint8_t *src2, int width,           \
+                                     uint32_t *opaque)                         \
+{                                                                              \
+    av_assert1(src1 == src2);                                                  \
+    xyz12ToUV_c_template((uint16_t *)dstU, (uint16_t *)dstV,                   \
+                         (const uint16_t *)src1, width,                        \
+                         (const SwsContext *)opaque, be, 0);                   \
+}                                                                              \
+                                                                               \
+static void xyz12 ## BE_LE ## ToUV_half_c(uint8_t *dstU, uint8_t *dstV,       \
+                                          const uint8_t *unused0, const uint8_t *src1, \
+                                          const uint8_t *src2, int width,      \
+                                          uint32_t *opaque)                    \
+{                                                                              \
+    av_assert1(src1 == src2);                                                  \
+    xyz12ToUV_c_template((uint16_t *)dstU, (uint16_t *)dstV,                   \
+                         (const uint16_t *)src1, width,                        \
+                         (const SwsContext *)opaque, be, 1);                   \
+}
+
+xyz12funcs(LE, 0)
+xyz12funcs(BE, 1)
+
 #define input_pixel(i) ((origin == AV_PIX_FMT_RGBA ||                      \
                          origin == AV_PIX_FMT_BGRA ||                      \
                          origin == AV_PIX_FMT_ARGB ||                      \
@@ -1753,4 +1847,14 @@ av_cold void ff_sws_init_input_funcs(SwsContext *c)
             break;
         }
     }
+
+    if (usesXYZReader(c)) {
+        if (isBE(srcFormat)) {
+            c->lumToYV12 = xyz12BEToY_c;
+            c->chrToYV12 = c->chrSrcHSubSample ? xyz12BEToUV_half_c : xyz12BEToUV_c;
+        } else {
+            c->lumToYV12 = xyz12LEToY_c;
+            c->chrToYV12 = c->chrSrcHSubSample ? xyz12LEToUV_half_c : xyz12LEToUV_c;
+        }
+    }
 }
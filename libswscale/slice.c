@@ -258,7 +258,9 @@ int ff_init_filters(SwsContext * c)
     int srcIdx, dstIdx;
     int dst_stride = FFALIGN(c->dstW * sizeof(int16_t) + 66, 16);
 
-    uint32_t * pal = usePal(c->srcFormat) ? c->pal_yuv : (uint32_t*)c->input_rgb2yuv_table;
+    uint32_t * pal = usePal(c->srcFormat) ? c->pal_yuv :
+                     usesXYZReader(c)     ? (uint32_t*)c :
+                                            (uint32_t*)c->input_rgb2yuv_table;
     int res = 0;
 
     int lumBufSize;
@@ -629,40 +629,40 @@ static int check_image_pointers(const uint8_t * const data[4], enum AVPixelForma
     return 1;
 }
 
-static void xyz12Torgb48(struct SwsContext *c, uint16_t *dst,
-                         const uint16_t *src, int stride, int h)
+static av_always_inline void
+xyz12Torgb48_c_template(const SwsContext *c, uint8_t *dst, ptrdiff_t dst_stride,
+                        const uint8_t *src, ptrdiff_t src_stride,
+                        int w, int h, int be)
 {
-    int xp,yp;
-    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(c->srcFormat);
+    const int16_t *xyzgamma = c->xyzgamma;
+    const int16_t *rgbgamma = c->rgbgamma;
+    const int16_t (*mat)[4] = c->xyz2rgb_matrix;
+
+    for (int yp = 0; yp < h; yp++) {
+        const uint16_t *src16 = (const uint16_t *)src;
+        uint16_t       *dst16 = (uint16_t *)dst;
 
-    for (yp=0; yp<h; yp++) {
-        for (xp=0; xp+2<stride; xp+=3) {
+        for (int xp = 0; xp < 3 * w; xp += 3) {
             int x, y, z, r, g, b;
 
-            if (desc->flags & AV_PIX_FMT_FLAG_BE) {
-                x = AV_RB16(src + xp + 0);
-                y = AV_RB16(src + xp + 1);
-                z = AV_RB16(src + xp + 2);
+            if (be) {
+                x = AV_RB16(src16 + xp + 0);
+                y = AV_RB16(src16 + xp + 1);
+                z = AV_RB16(src16 + xp + 2);
             } else {
-                x = AV_RL16(src + xp + 0);
-                y = AV_RL16(src + xp + 1);
-                z = AV_RL16(src + xp + 2);
+                x = AV_RL16(src16 + xp + 0);
+                y = AV_RL16(src16 + xp + 1);
+                z = AV_RL16(src16 + xp + 2);
             }
 
-            x = c->xyzgamma[x>>4];
-            y = c->xyzgamma[y>>4];
-            z = c->xyzgamma[z>>4];
+            x = xyzgamma[x >> 4];
+            y = xyzgamma[y >> 4];
+            z = xyzgamma[z >> 4];
 
             // convert from XYZlinear to sRGBlinear
-            r = c->xyz2rgb_matrix[0][0] * x +
-                c->xyz2rgb_matrix[0][1] * y +
-                c->xyz2rgb_matrix[0][2] * z >> 12;
-            g = c->xyz2rgb_matrix[1][0] * x +
-                c->xyz2rgb_matrix[1][1] * y +
-                c->xyz2rgb_matrix[1][2] * z >> 12;
-            b = c->xyz2rgb_matrix[2][0] * x +
-                c->xyz2rgb_matrix[2][1] * y +
-                c->xyz2rgb_matrix[2][2] * z >> 12;
+            r = mat[0][0] * x + mat[0][1] * y + mat[0][2] * z >> 12;
+            g = mat[1][0] * x + mat[1][1] * y + mat[1][2] * z >> 12;
+            b = mat[2][0] * x + mat[2][1] * y + mat[2][2] * z >> 12;
 
             // limit values to 12-bit depth
             r = av_clip_uintp2(r, 12);
@@ -670,55 +670,55 @@ static void xyz12Torgb48(struct SwsContext *c, uint16_t *dst,
             b = av_clip_uintp2(b, 12);
 
             // convert from sRGBlinear to RGB and scale from 12bit to 16bit
-            if (desc->flags & AV_PIX_FMT_FLAG_BE) {
-                AV_WB16(dst + xp + 0, c->rgbgamma[r] << 4);
-                AV_WB16(dst + xp + 1, c->rgbgamma[g] << 4);
-                AV_WB16(dst + xp + 2, c->rgbgamma[b] << 4);
+            if (be) {
+                AV_WB16(dst16 + xp + 0, rgbgamma[r] << 4);
+                AV_WB16(dst16 + xp + 1, rgbgamma[g] << 4);
+                AV_WB16(dst16 + xp + 2, rgbgamma[b] << 4);
             } else {
-                AV_WL16(dst + xp + 0, c->rgbgamma[r] << 4);
-                AV_WL16(dst + xp + 1, c->rgbgamma[g] << 4);
-                AV_WL16(dst + xp + 2, c->rgbgamma[b] << 4);
+                AV_WL16(dst16 + xp + 0, rgbgamma[r] << 4);
+                AV_WL16(dst16 + xp + 1, rgbgamma[g] << 4);
+                AV_WL16(dst16 + xp + 2, rgbgamma[b] << 4);
             }
         }
-        src += stride;
-        dst += stride;
+        src += src_stride;
+        dst += dst_stride;
     }
 }
 
-static void rgb48Toxyz12(struct SwsContext *c, uint16_t *dst,
-                         const uint16_t *src, int stride, int h)
+static av_always_inline void
+rgb48Toxyz12_c_template(const SwsContext *c, uint8_t *dst, ptrdiff_t dst_stride,
+                        const uint8_t *src, ptrdiff_t src_stride,
+                        int w, int h, int be)
 {
-    int xp,yp;
-    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(c->dstFormat);
+    const int16_t *rgbgammainv = c->rgbgammainv;
+    const int16_t *xyzgammainv = c->xyzgammainv;
+    const int16_t (*mat)[4]    = c->rgb2xyz_matrix;
+
+    for (int yp = 0; yp < h; yp++) {
+        const uint16_t *src16 = (const uint16_t *)src;
+        uint16_t       *dst16 = (uint16_t *)dst;
 
-    for (yp=0; yp<h; yp++) {
-        for (xp=0; xp+2<stride; xp+=3) {
+        for (int xp = 0; xp < 3 * w; xp += 3) {
             int x, y, z, r, g, b;
 
-            if (desc->flags & AV_PIX_FMT_FLAG_BE) {
-                r = AV_RB16(src + xp + 0);
-                g = AV_RB16(src + xp + 1);
-                b = AV_RB16(src + xp + 2);
+            if (be) {
+                r = AV_RB16(src16 + xp + 0);
+                g = AV_RB16(src16 + xp + 1);
+                b = AV_RB16(src16 + xp + 2);
             } else {
-                r = AV_RL16(src + xp + 0);
-                g = AV_RL16(src + xp + 1);
-                b = AV_RL16(src + xp + 2);
+                r = AV_RL16(src16 + xp + 0);
+                g = AV_RL16(src16 + xp + 1);
+                b = AV_RL16(src16 + xp + 2);
             }
 
-            r = c->rgbgammainv[r>>4];
-            g = c->rgbgammainv[g>>4];
-            b = c->rgbgammainv[b>>4];
+            r = rgbgammainv[r >> 4];
+            g = rgbgammainv[g >> 4];
+            b = rgbgammainv[b >> 4];
 
             // convert from sRGBlinear to XYZlinear
-            x = c->rgb2xyz_matrix[0][0] * r +
-                c->rgb2xyz_matrix[0][1] * g +
-                c->rgb2xyz_matrix[0][2] * b >> 12;
-            y = c->rgb2xyz_matrix[1][0] * r +
-                c->rgb2xyz_matrix[1][1] * g +
-                c->rgb2xyz_matrix[1][2] * b >> 12;
-            z = c->rgb2xyz_matrix[2][0] * r +
-                c->rgb2xyz_matrix[2][1] * g +
-                c->rgb2xyz_matrix[2][2] * b >> 12;
+            x = mat[0][0] * r + mat[0][1] * g + mat[0][2] * b >> 12;
+            y = mat[1][0] * r + mat[1][1] * g + mat[1][2] * b >> 12;
+            z = mat[2][0] * r + mat[2][1] * g + mat[2][2] * b >> 12;
 
             // limit values to 12-bit depth
             x = av_clip_uintp2(x, 12);
@@ -726,21 +726,47 @@ static void rgb48Toxyz12(struct SwsContext *c, uint16_t *dst,
             z = av_clip_uintp2(z, 12);
 
             // convert from XYZlinear to X'Y'Z' and scale from 12bit to 16bit
-            if (desc->flags & AV_PIX_FMT_FLAG_BE) {
-                AV_WB16(dst + xp + 0, c->xyzgammainv[x] << 4);
-                AV_WB16(dst + xp + 1, c->xyzgammainv[y] << 4);
-                AV_WB16(dst + xp + 2, c->xyzgammainv[z] << 4);
+            if (be) {
+                AV_WB16(dst16 + xp + 0, xyzgammainv[x] << 4);
+                AV_WB16(dst16 + xp + 1, xyzgammainv[y] << 4);
+                AV_WB16(dst16 + xp + 2, xyzgammainv[z] << 4);
             } else {
-                AV_WL16(dst + xp + 0, c->xyzgammainv[x] << 4);
-                AV_WL16(dst + xp + 1, c->xyzgammainv[y] << 4);
-                AV_WL16(dst + xp + 2, c->xyzgammainv[z] << 4);
+                AV_WL16(dst16 + xp + 0, xyzgammainv[x] << 4);
+                AV_WL16(dst16 + xp + 1, xyzgammainv[y] << 4);
+                AV_WL16(dst16 + xp + 2, xyzgammainv[z] << 4);
             }
         }
-        src += stride;
-        dst += stride;
+        src += src_stride;
+        dst += dst_stride;
     }
 }
 
+#define XYZ_FUNCS(endian, be)                                                  \
+static void xyz12Torgb48_ ## endian ## _c(const SwsContext *c,                 \
+                                          uint8_t *dst, ptrdiff_t dst_stride,  \
+                                          const uint8_t *src, ptrdiff_t src_stride, \
+                                          int w, int h)                        \
+{                                                                              \
+    xyz12Torgb48_c_template(c, dst, dst_stride, src, src_stride, w, h, be);    \
+}                                                                              \
+                                                                               \
+static void rgb48Toxyz12_ ## endian ## _c(const SwsContext *c,                 \
+                                          uint8_t *dst, ptrdiff_t dst_stride,  \
+                                          const uint8_t *src, ptrdiff_t src_stride, \
+                                          int w, int h)                        \
+{                                                                              \
+    rgb48Toxyz12_c_template(c, dst, dst_stride, src, src_stride, w, h, be);    \
+}
+
+XYZ_FUNCS(le, 0)
+XYZ_FUNCS(be, 1)
+
+av_cold void ff_sws_init_xyzdsp(SwsContext *c)
+{
+    c->xyz12Torgb48 = isBE(c->srcFormat) ? xyz12Torgb48_be_c : xyz12Torgb48_le_c;
+    c->rgb48Toxyz12 = isBE(c->dstFormat) ? rgb48Toxyz12_be_c : rgb48Toxyz12_le_c;
+}
+
 static void update_palette(SwsContext *c, const uint32_t *pal)
 {
     for (int i = 0; i < 256; i++) {
@@ -975,7 +1001,9 @@ static int scale_internal(SwsContext *c,
         src2[0] = base;
     }
 
-    if (c->srcXYZ && !(c->dstXYZ && c->srcW==c->dstW && c->srcH==c->dstH)) {
+    // the scaler reads XYZ input directly, only unscaled conversions need RGB48
+    if (c->srcXYZ && c->convert_unscaled &&
+        !(c->dstXYZ && c->srcW==c->dstW && c->srcH==c->dstH)) {
         uint8_t *base;
 
         av_fast_malloc(&c->xyz_scratch, &c->xyz_scratch_allocated,
@@ -986,7 +1014,15 @@ static int scale_internal(SwsContext *c,
         base = srcStride[0] < 0 ? c->xyz_scratch - srcStride[0] * (srcSliceH-1) :
                                   c->xyz_scratch;
 
-        xyz12Torgb48(c, (uint16_t*)base, (const uint16_t*)src2[0], srcStride[0]/2, srcSliceH);
+        if (scale_dst) {
+            // only convert the source lines of this slice of the output
+            c->xyz12Torgb48(c, base + dstSliceY * srcStride[0], srcStride[0],
+                            src2[0] + dstSliceY * srcStride[0], srcStride[0],
+                            c->srcW, dstSliceH);
+        } else {
+            c->xyz12Torgb48(c, base, srcStride[0], src2[0], srcStride[0],
+                            c->srcW, srcSliceH);
+        }
         src2[0] = base;
     }
 
@@ -1058,7 +1094,8 @@ static int scale_internal(SwsContext *c,
         }
 
         /* replace on the same data */
-        rgb48Toxyz12(c, dst16, dst16, dstStride2[0]/2, ret);
+        c->rgb48Toxyz12(c, (uint8_t *)dst16, dstStride2[0],
+                        (const uint8_t *)dst16, dstStride2[0], c->dstW, ret);
     }
 
     /* reset slice direction at end of frame */
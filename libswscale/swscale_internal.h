@@ -550,6 +550,17 @@ typedef struct SwsContext {
     int16_t xyz2rgb_matrix[3][4];
     int16_t rgb2xyz_matrix[3][4];
 
+    /**
+     * Convert w pixels of h lines between XYZ12 and RGB48 in the endianness
+     * of the XYZ side. rgb48Toxyz12() may be called with dst == src.
+     */
+    /** @{ */
+    void (*xyz12Torgb48)(const struct SwsContext *c, uint8_t *dst, ptrdiff_t dst_stride,
+                         const uint8_t *src, ptrdiff_t src_stride, int w, int h);
+    void (*rgb48Toxyz12)(const struct SwsContext *c, uint8_t *dst, ptrdiff_t dst_stride,
+                         const uint8_t *src, ptrdiff_t src_stride, int w, int h);
+    /** @} */
+
     /* function pointers for swscale() */
     yuv2planar1_fn yuv2plane1;
     yuv2planarX_fn yuv2planeX;
@@ -687,6 +698,17 @@ void ff_yuv2rgb_init_tables_ppc(SwsContext *c, const int inv_table[4],
 void ff_updateMMXDitherTables(SwsContext *c, int dstY);
 
 av_cold void ff_sws_init_range_convert(SwsContext *c);
+av_cold void ff_sws_init_xyzdsp(SwsContext *c);
+
+/**
+ * Whether XYZ input is converted by the input functions of the horizontal
+ * scaler. Otherwise it goes through xyz_scratch or needs no conversion.
+ */
+static av_always_inline int usesXYZReader(const SwsContext *c)
+{
+    return c->srcXYZ && !c->convert_unscaled &&
+           !(c->dstXYZ && c->srcW == c->dstW && c->srcH == c->dstH);
+}
 
 SwsFunc ff_yuv2rgb_init_x86(SwsContext *c);
 SwsFunc ff_yuv2rgb_init_ppc(SwsContext *c);
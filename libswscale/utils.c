@@ -1162,8 +1162,10 @@ static void handle_formats(SwsContext *c)
     c->dst0Alpha |= handle_0alpha(&c->dstFormat);
     c->srcXYZ    |= handle_xyz(&c->srcFormat);
     c->dstXYZ    |= handle_xyz(&c->dstFormat);
-    if (c->srcXYZ || c->dstXYZ)
+    if (c->srcXYZ || c->dstXYZ) {
         fill_xyztables(c);
+        ff_sws_init_xyzdsp(c);
+    }
 }
 
 SwsContext *sws_alloc_context(void)
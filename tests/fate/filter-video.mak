@@ -129,6 +129,9 @@ FATE_FILTER-$(call ALLYES, MINTERPOLATE_FILTER TESTSRC2_FILTER) += fate-filter-m
 fate-filter-minterpolate-up: CMD = framecrc -lavfi testsrc2=r=2:d=10,minterpolate=fps=10 -t 1
 fate-filter-minterpolate-down: CMD = framecrc -lavfi testsrc2=r=2:d=10,minterpolate=fps=1 -t 1
 
+FATE_FILTER-$(call ALLYES, MINTERPOLATE_FILTER TESTSRC2_FILTER) += fate-filter-minterpolate-threads
+fate-filter-minterpolate-threads: CMD = framecrc -filter_threads 4 -lavfi testsrc2=r=2:d=10,minterpolate=fps=10:mc_mode=aobmc:vsbmc=1 -t 1
+
 FATE_FILTER_VSYNTH-$(CONFIG_BOXBLUR_FILTER) += fate-filter-boxblur
 fate-filter-boxblur: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf boxblur=2:1
 
@@ -172,6 +175,10 @@ fate-filter-negate: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf perms=random,negate
 FATE_FILTER_VSYNTH-$(CONFIG_HISTOGRAM_FILTER) += fate-filter-histogram-levels
 fate-filter-histogram-levels: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf histogram -flags +bitexact -sws_flags +accurate_rnd+bitexact
 
+FATE_FILTER_VSYNTH-$(CONFIG_HISTOGRAM_FILTER) += fate-filter-histogram-levels-threads
+fate-filter-histogram-levels-threads: CMD = framecrc -filter_threads 4 -c:v pgmyuv -i $(SRC) -vf histogram -flags +bitexact -sws_flags +accurate_rnd+bitexact
+fate-filter-histogram-levels-threads: REF = $(SRC_PATH)/tests/ref/fate/filter-histogram-levels
+
 FATE_FILTER_VSYNTH-$(CONFIG_WAVEFORM_FILTER) += fate-filter-waveform_column
 fate-filter-waveform_column: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf waveform -flags +bitexact -sws_flags +accurate_rnd+bitexact
 
@@ -196,6 +203,13 @@ fate-filter-vectorscope_color2: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf vectors
 FATE_FILTER_VSYNTH-$(CONFIG_VECTORSCOPE_FILTER) += fate-filter-vectorscope_color3
 fate-filter-vectorscope_color3: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf vectorscope=color3 -sws_flags +accurate_rnd+bitexact -frames:v 3
 
+FATE_FILTER_VSYNTH-$(CONFIG_VECTORSCOPE_FILTER) += fate-filter-vectorscope_color3-threads
+fate-filter-vectorscope_color3-threads: CMD = framecrc -filter_threads 4 -c:v pgmyuv -i $(SRC) -vf vectorscope=color3 -sws_flags +accurate_rnd+bitexact -frames:v 3
+fate-filter-vectorscope_color3-threads: REF = $(SRC_PATH)/tests/ref/fate/filter-vectorscope_color3
+
+FATE_FILTER_VSYNTH-$(call ALLYES, FORMAT_FILTER SCALE_FILTER VECTORSCOPE_FILTER) += fate-filter-vectorscope_color4-12bit-threads
+fate-filter-vectorscope_color4-12bit-threads: CMD = framecrc -filter_threads 4 -c:v pgmyuv -i $(SRC) -vf scale,format=yuv444p12le,vectorscope=color4 -sws_flags +accurate_rnd+bitexact -frames:v 3
+
 FATE_FILTER_VSYNTH-$(CONFIG_VECTORSCOPE_FILTER) += fate-filter-vectorscope_color4
 fate-filter-vectorscope_color4: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf vectorscope=color4 -sws_flags +accurate_rnd+bitexact -frames:v 3
 
@@ -575,12 +589,32 @@ fate-filter-hue3: CMD = video_filter "perms=random,hue=b=n-10" -frames:v 20
 FATE_FILTER_VSYNTH-$(call ALLYES, FORMAT_FILTER PERMS_FILTER HUE_FILTER) += fate-filter-hue4
 fate-filter-hue4: CMD = video_filter "scale,format=yuv422p10,perms=random,hue=h=18*n:s=n/10,scale" -frames:v 20 -pix_fmt yuv422p10le
 
+FATE_FILTER_VSYNTH-$(CONFIG_DESHAKE_FILTER) += fate-filter-deshake fate-filter-deshake-threads
+fate-filter-deshake: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf deshake -frames:v 10
+fate-filter-deshake-threads: CMD = framecrc -filter_threads 4 -c:v pgmyuv -i $(SRC) -vf deshake -frames:v 10
+fate-filter-deshake-threads: REF = $(SRC_PATH)/tests/ref/fate/filter-deshake
+
 FATE_FILTER_VSYNTH-$(CONFIG_IDET_FILTER) += fate-filter-idet
 fate-filter-idet: CMD = framecrc -flags bitexact -idct simple -i $(SRC) -vf idet -frames:v 25 -flags +bitexact
 
+FATE_FILTER_VSYNTH-$(CONFIG_IDET_FILTER) += fate-filter-idet-threads
+fate-filter-idet-threads: CMD = framecrc -filter_threads 4 -flags bitexact -idct simple -i $(SRC) -vf idet -frames:v 25 -flags +bitexact
+fate-filter-idet-threads: REF = $(SRC_PATH)/tests/ref/fate/filter-idet
+
+FATE_FILTER_VSYNTH-$(call ALLYES, TELECINE_FILTER FIELDMATCH_FILTER) += fate-filter-fieldmatch fate-filter-fieldmatch-threads
+fate-filter-fieldmatch: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf telecine,fieldmatch=combmatch=full -frames:v 25
+fate-filter-fieldmatch-threads: CMD = framecrc -filter_threads 4 -c:v pgmyuv -i $(SRC) -vf telecine,fieldmatch=combmatch=full -frames:v 25
+fate-filter-fieldmatch-threads: REF = $(SRC_PATH)/tests/ref/fate/filter-fieldmatch
+
 FATE_FILTER_VSYNTH-$(CONFIG_PAD_FILTER) += fate-filter-pad
 fate-filter-pad: CMD = video_filter "pad=iw*1.5:ih*1.5:iw*0.3:ih*0.2"
 
+FATE_FILTER-$(call ALLYES, TESTSRC2_FILTER FORMAT_FILTER PAD_FILTER) += fate-filter-pad-threads
+fate-filter-pad-threads: CMD = framecrc -filter_threads 4 -lavfi testsrc2=s=320x240:r=5:d=1,format=yuv420p,pad=iw+64:ih+33:x=21:y=9:color=red
+
+FATE_FILTER_VSYNTH-$(CONFIG_PAD_FILTER) += fate-filter-pad-copy-threads
+fate-filter-pad-copy-threads: CMD = framecrc -filter_threads 4 -c:v pgmyuv -i $(SRC) -vf pad=iw+64:ih+33:x=21:y=9:color=red -frames:v 5
+
 FATE_FILTER_PP = fate-filter-pp fate-filter-pp1 fate-filter-pp2 fate-filter-pp3 fate-filter-pp4 fate-filter-pp5 fate-filter-pp6
 FATE_FILTER_VSYNTH-$(CONFIG_PP_FILTER) += $(FATE_FILTER_PP)
 $(FATE_FILTER_PP): fate-vsynth1-mpeg4-qprd
@@ -823,6 +857,9 @@ FREEZEDETECT_DEPS = FFPROBE AVDEVICE LAVFI_INDEV MPTESTSRC_FILTER SCALE_FILTER F
 FATE_METADATA_FILTER-$(call ALLYES, $(FREEZEDETECT_DEPS)) += fate-filter-metadata-freezedetect
 fate-filter-metadata-freezedetect: CMD = run $(FILTER_METADATA_COMMAND) "sws_flags=+accurate_rnd+bitexact;mptestsrc=r=25:d=10:m=51,freezedetect"
 
+FATE_FILTER-$(call ALLYES, TESTSRC2_FILTER FPS_FILTER FREEZEDETECT_FILTER SCDET_FILTER METADATA_FILTER NULL_MUXER) += fate-filter-freezedetect-scdet-threads
+fate-filter-freezedetect-scdet-threads: CMD = ffmpeg -filter_threads 4 -lavfi "testsrc2=s=317x239:r=2:d=2,fps=10,freezedetect=d=0.3,scdet=t=1,metadata=print:file=-" -f null -
+
 SIGNALSTATS_DEPS = FFPROBE AVDEVICE LAVFI_INDEV COLOR_FILTER SCALE_FILTER SIGNALSTATS_FILTER
 FATE_METADATA_FILTER-$(call ALLYES, $(SIGNALSTATS_DEPS)) += fate-filter-metadata-signalstats-yuv420p fate-filter-metadata-signalstats-yuv420p10
 fate-filter-metadata-signalstats-yuv420p: CMD = run $(FILTER_METADATA_COMMAND) "sws_flags=+accurate_rnd+bitexact;color=white:duration=1:r=1,signalstats"
@@ -0,0 +1,15 @@
+FATE_JPEG2000_ENC-$(call TRANSCODE, JPEG2000, AVI, RAWVIDEO_DEMUXER RAWVIDEO_DECODER) += fate-jpeg2000enc-tlm-plt
+fate-jpeg2000enc-tlm-plt: tests/data/vsynth1.yuv
+fate-jpeg2000enc-tlm-plt: CMD = transcode "rawvideo -s 352x288 -pix_fmt yuv420p" tests/data/vsynth1.yuv avi "-c:v jpeg2000 -frames:v 2 -layer_rates 40,10 -sop 1 -eph 1 -tlm 1 -plt 1"
+
+FATE_JPEG2000_ENC-$(call TRANSCODE, JPEG2000, AVI, RAWVIDEO_DEMUXER RAWVIDEO_DECODER) += fate-jpeg2000enc-precincts
+fate-jpeg2000enc-precincts: tests/data/vsynth1.yuv
+fate-jpeg2000enc-precincts: CMD = transcode "rawvideo -s 352x288 -pix_fmt yuv420p" tests/data/vsynth1.yuv avi "-c:v jpeg2000 -frames:v 2 -pred 1 -prog rpcl -precincts 64x64,32x32,16x16"
+
+FATE_JPEG2000_ENC-$(call TRANSCODE, JPEG2000, AVI, RAWVIDEO_DEMUXER RAWVIDEO_DECODER) += fate-jpeg2000enc-bypass
+fate-jpeg2000enc-bypass: tests/data/vsynth1.yuv
+fate-jpeg2000enc-bypass: CMD = transcode "rawvideo -s 352x288 -pix_fmt yuv420p" tests/data/vsynth1.yuv avi "-c:v jpeg2000 -frames:v 2 -pred 1 -bypass 1 -layer_rates 20,5,1"
+
+FATE_FFMPEG += $(FATE_JPEG2000_ENC-yes)
+
+fate-jpeg2000enc: $(FATE_JPEG2000_ENC-yes)
@@ -52,11 +52,24 @@ FATE_MXF_OPATOM_USER_COMMENTS-$(call ENCDEC2, MPEG2VIDEO, PCM_S16LE, MXF) += fat
 fate-mxf-opatom-user-comments: $(SAMPLES)/mxf/Sony-00001.mxf
 fate-mxf-opatom-user-comments: CMD = md5 -y -i $(TARGET_SAMPLES)/mxf/Sony-00001.mxf -an -vcodec copy -metadata "comment_test=value" -fflags +bitexact -f mxf_opatom
 
+FATE_MXF_J2K_FRAME_SIZE-$(call ENCDEC2, JPEG2000, PCM_S16LE, MXF, IMAGE2_DEMUXER PGMYUV_DECODER PCM_S16LE_DEMUXER PIPE_PROTOCOL) += fate-mxf-j2k-frame-size-overflow
+fate-mxf-j2k-frame-size-overflow: CMD = ffmpeg -f image2 -c:v pgmyuv -i $(TARGET_PATH)/tests/vsynth1/%02d.pgm -frames:v 1 -c:v jpeg2000 -fflags +bitexact -j2k_frame_size 16384 -f mxf - ; test $$? != 0
+fate-mxf-j2k-frame-size-overflow: CMP = grep
+fate-mxf-j2k-frame-size-overflow: REF = track 0: frame size [0-9]* exceeds j2k_frame_size 16384
+
+FATE_MXF_J2K_FRAME_SIZE-$(call ENCDEC2, JPEG2000, PCM_S16LE, MXF, IMAGE2_DEMUXER PGMYUV_DECODER PCM_S16LE_DEMUXER PIPE_PROTOCOL) += fate-mxf-j2k-frame-size-ntsc-audio
+fate-mxf-j2k-frame-size-ntsc-audio: CMD = ffmpeg -f image2 -c:v pgmyuv -i $(TARGET_PATH)/tests/vsynth1/%02d.pgm -ar 48000 -ac 2 -f s16le -i $(TARGET_PATH)/tests/data/asynth1.sw -frames:v 1 -r 30000/1001 -c:v jpeg2000 -fflags +bitexact -j2k_frame_size 65536 -f mxf - ; test $$? != 0
+fate-mxf-j2k-frame-size-ntsc-audio: CMP = grep
+fate-mxf-j2k-frame-size-ntsc-audio: REF = track 1: element size varies between edit units, j2k_frame_size cannot be used
+
+$(FATE_MXF_J2K_FRAME_SIZE-yes): $(AREF) $(VREF)
+
 FATE_MXF-$(CONFIG_MXF_DEMUXER) += $(FATE_MXF)
 
 FATE_SAMPLES_AVCONV += $(FATE_MXF-yes) $(FATE_MXF_REEL_NAME-yes)
 FATE_SAMPLES_AVCONV += $(FATE_MXF_USER_COMMENTS-yes) $(FATE_MXF_OPATOM_USER_COMMENTS-yes)
 FATE_SAMPLES_FFMPEG_FFPROBE += $(FATE_MXF_D10_USER_COMMENTS-yes)
 FATE_SAMPLES_FFPROBE += $(FATE_MXF_PROBE-yes)
+FATE_FFMPEG += $(FATE_MXF_J2K_FRAME_SIZE-yes)
 
-fate-mxf: $(FATE_MXF-yes) $(FATE_MXF_PROBE-yes) $(FATE_MXF_REEL_NAME-yes) $(FATE_MXF_USER_COMMENTS-yes) $(FATE_MXF_D10_USER_COMMENTS-yes) $(FATE_MXF_OPATOM_USER_COMMENTS-yes)
+fate-mxf: $(FATE_MXF-yes) $(FATE_MXF_PROBE-yes) $(FATE_MXF_REEL_NAME-yes) $(FATE_MXF_USER_COMMENTS-yes) $(FATE_MXF_D10_USER_COMMENTS-yes) $(FATE_MXF_OPATOM_USER_COMMENTS-yes) $(FATE_MXF_J2K_FRAME_SIZE-yes)
@@ -138,6 +138,7 @@ FATE_SEEK += $(FATE_SEEK_LAVF_AUDIO)
 
 FATE_SEEK_LAVF_CONTAINER += asf avi dv flv gxf mkv mov mpg    \
                             mxf mxf_d10 mxf_dv25 mxf_dvcpro50 \
+                            mxf_j2k                           \
                             mxf_opatom mxf_opatom_audio       \
                             nut swf ts wtv
 # rm is special: fate-lavf-rm does not read the created file